@@ -2,14 +2,15 @@
 
 out vec4 fragColor;
 
-uniform mat4 cameraTransform;
+// Inverse of the camera matrix, computed once per frame on the CPU
+uniform mat4 screenToWorld;
 uniform vec2 screenSize;
 uniform float gridSize = 50.0;
 
 void main() {
     vec2 actual = gl_FragCoord.xy;
     actual.y = screenSize.y - actual.y;
-    vec4 worldPos = inverse(cameraTransform) * vec4(actual, 0.0, 1.0);
+    vec2 worldPos = (screenToWorld * vec4(actual, 0.0, 1.0)).xy;
 
     float lineX = mod(worldPos.x, gridSize) < 4.0 ? 1.0 : 0.0;
     float lineY = mod(worldPos.y, gridSize) < 4.0 ? 1.0 : 0.0;
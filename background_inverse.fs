@@ -0,0 +1,22 @@
+#version 330
+
+out vec4 fragColor;
+
+// The grid as it was drawn before background.fs took the inverse from the
+// CPU: every fragment inverts the camera matrix itself. Kept to time the
+// two against each other with --background shader-inverse.
+uniform mat4 cameraTransform;
+uniform vec2 screenSize;
+uniform float gridSize = 50.0;
+
+void main() {
+    vec2 actual = gl_FragCoord.xy;
+    actual.y = screenSize.y - actual.y;
+    vec4 worldPos = inverse(cameraTransform) * vec4(actual, 0.0, 1.0);
+
+    float lineX = mod(worldPos.x, gridSize) < 4.0 ? 1.0 : 0.0;
+    float lineY = mod(worldPos.y, gridSize) < 4.0 ? 1.0 : 0.0;
+    
+    float grid = lineX * lineY;
+    fragColor = vec4(0.2, 0.2, 0.3, grid);
+}
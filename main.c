@@ -1,5 +1,24 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "raylib.h"
 #include "raymath.h"
@@ -14,500 +33,5315 @@ const float BOOST = 4;
 const float DEADZONE = 0.1;
 const float ZOOM_MAX = 2.0;
 
+// Simulation runs at a fixed rate, rendering interpolates between ticks.
+// A long hitch only replays up to MAX_CATCHUP_TICKS and drops the rest.
+const int TICK_RATE = 60;
+const int MAX_CATCHUP_TICKS = 5;
+
 typedef struct SnakePart {
-  struct SnakePart* next;
   Vector2 pos;
   float length;
 } SnakePart;
 
+// Growable ring buffer of body parts, stored as separate x, y and length
+// arrays so moveSnake can stream through them with SIMD. Logical index 0 is
+// the tail and count - 1 is the head, so pushing either end or popping the
+// tail is O(1) and walking the body is a linear pass.
+typedef struct {
+  float* x;
+  float* y;
+  float* length;
+  float* prev_x; // Positions at the start of the current tick, for rendering
+  float* prev_y; // between ticks
+  int capacity; // Always a power of two so indices wrap with a mask
+  int start;    // Physical index of the tail
+  int count;
+} SnakeBody;
+
 typedef struct {
-  SnakePart* head;
-  SnakePart* tail;
+  SnakeBody body;
   float thickness;
-  int length;
   Vector2 movement_direction;
   Vector2 look_direction;
   float boost_time;
   float current_speed;
 } Snake;
 
-void addSnakeFront(Snake* self, Vector2 pos, float length) {
-  SnakePart* new = malloc(sizeof(SnakePart));
-  new->pos = pos;
-  new->length = length;
-  new->next = NULL;
+int snakePartIndex(const SnakeBody* body, int i) {
+  return (body->start + i) & (body->capacity - 1);
+}
 
-  self->length++;
+SnakePart snakePart(const SnakeBody* body, int i) {
+  int j = snakePartIndex(body, i);
+  return (SnakePart){{body->x[j], body->y[j]}, body->length[j]};
+}
 
-  if (self->head == NULL) {
-    self->head = new;
-    self->tail = new;
-    return;
-  }
+// New parts start at rest, they have nowhere to be interpolated from
+void setSnakePart(SnakeBody* body, int i, SnakePart part) {
+  int j = snakePartIndex(body, i);
+  body->x[j] = body->prev_x[j] = part.pos.x;
+  body->y[j] = body->prev_y[j] = part.pos.y;
+  body->length[j] = part.length;
+}
 
-  self->head->next = new;
-  self->head = new;
+// Position of part i blended between the previous and current tick
+Vector2 snakePartLerp(const SnakeBody* body, int i, float alpha) {
+  int j = snakePartIndex(body, i);
+  return (Vector2){
+    Lerp(body->prev_x[j], body->x[j], alpha),
+    Lerp(body->prev_y[j], body->y[j], alpha),
+  };
 }
 
-void addSnakeTail(Snake* self, Vector2 pos, float length) {
-  SnakePart* new = malloc(sizeof(SnakePart));
-  new->pos = pos;
-  new->length = length;
+SnakePart snakeHead(const Snake* self) {
+  return snakePart(&self->body, self->body.count - 1);
+}
 
-  new->next = self->tail;
-  self->tail = new;
-  self->length++;
+SnakePart snakeTail(const Snake* self) {
+  return snakePart(&self->body, 0);
 }
 
+#define SNAKE_BODY_ARRAYS 5
 
-void popSnakeTail(Snake* self) {
-  SnakePart* temp = self->tail; 
-  self->tail = self->tail->next;
-  free(temp);
-  self->length--;
+// Part slots across every SnakeBody. Popped tails stay in their ring as
+// free slots and are reused by the next push, so live + free only moves
+// when a body grows or is freed.
+typedef struct {
+  long live;        // Slots holding a part
+  long free;        // Allocated slots holding nothing
+  long peak;        // Most live parts at once
+  long allocations; // Blocks allocated for body storage
+} SnakeBodyStats;
+
+SnakeBodyStats snakeBodyStats;
+
+void logSnakeBodyStats() {
+  TraceLog(
+      LOG_INFO, "BODY: %ld live, %ld free, %ld peak parts, %ld allocations",
+      snakeBodyStats.live, snakeBodyStats.free,
+      snakeBodyStats.peak, snakeBodyStats.allocations
+  );
 }
 
-void moveSnake(Snake* self, float dt) {
-  float speed = SPEED;
-  if (self->boost_time > 0) {
-    speed *= BOOST;
-    self->boost_time -= dt;
+void countSnakeParts(long added) {
+  snakeBodyStats.live += added;
+  snakeBodyStats.free -= added;
+  if (snakeBodyStats.live > snakeBodyStats.peak) {
+    snakeBodyStats.peak = snakeBodyStats.live;
   }
-  self->current_speed = Lerp(self->current_speed, speed, dt / 0.2);
-  for (SnakePart* part = self->tail; part != NULL; part = part->next){
-    if (part->next == NULL) {
-      part->pos = Vector2Add(
-          part->pos,
-          Vector2Scale(self->movement_direction, self->current_speed * dt)
-      );
-    }
-    else {
-      Vector2 dpos = Vector2Subtract(part->next->pos, part->pos);
-      if ( Vector2Length(dpos) > part->length) {
-        part->pos = Vector2Add(
-            part->pos,
-            Vector2Scale(
-              dpos,
-              dt * SPEED
-            )
-        );
-      }
-    }
-  };
 }
 
-void renderSnake(Snake* snake) {
-  int i = snake->length - 1;
-  Color colors[] =
-    {
-      {250, .a = 255},
-      {250, .a = 255},
-      {250, .a = 255},
-      {250, .a = 255},
-      {250, .a = 255},
-      {250, .a = 255},
-      {250, .a = 255},
-      {250, .a = 255},
-      WHITE,
-    };
-  int colorCount = sizeof(colors) / sizeof(Color);
-
-  for (SnakePart* part = snake->tail; part != NULL; part = part->next) {
-    Vector2 pos = part->pos;
-    
-    int colorIndex = i % colorCount;
-
-    if (part->next != NULL) {
-      DrawCircleV(pos, snake->thickness, colors[colorIndex]);
-    }
-    else {
-      // Head
-      DrawCircleV(pos, snake->thickness * 1.2, colors[colorIndex]);
+// All arrays live in one block, x first
+void snakeBodyArrays(SnakeBody* body, float** arrays[SNAKE_BODY_ARRAYS]) {
+  arrays[0] = &body->x;
+  arrays[1] = &body->y;
+  arrays[2] = &body->length;
+  arrays[3] = &body->prev_x;
+  arrays[4] = &body->prev_y;
+}
 
-      // Right Eye
-      DrawCircleV(
-          Vector2Add(
-            Vector2Add(
-              pos,
-              Vector2Scale(snake->movement_direction, snake->thickness * 0.6)
-            ),
-            Vector2Scale(
-              Vector2Rotate(snake->movement_direction, PI/2),
-              snake->thickness * 0.5
-            )
-          ),
-          snake->thickness * 0.4, WHITE);
-      DrawCircleV(
-          Vector2Add(
-            Vector2Add(
-              pos,
-              Vector2Add(
-                Vector2Scale(
-                  snake->movement_direction,
-                  snake->thickness * 0.6
-                ),
-                Vector2Scale(
-                  snake->look_direction,
-                  snake->thickness * 0.2
-                )
-              )
-            ),
-            Vector2Scale(
-              Vector2Rotate(snake->movement_direction, PI/2),
-              snake->thickness * 0.5
-            )
-          ),
-          snake->thickness * 0.2, BLACK);
+// Copies the live parts of a ring array into dst starting at index 0
+void unwrapSnakeArray(const SnakeBody* body, float* dst, const float* src) {
+  int first = body->capacity - body->start;
+  if (first >= body->count) {
+    memcpy(dst, src + body->start, sizeof(float) * body->count);
+    return;
+  }
+  memcpy(dst, src + body->start, sizeof(float) * first);
+  memcpy(dst + first, src, sizeof(float) * (body->count - first));
+}
 
-      // Left Eye
-      DrawCircleV(
-          Vector2Add(
-            Vector2Add(
-              pos,
-              Vector2Scale(snake->movement_direction, snake->thickness * 0.6)
-            ),
-            Vector2Scale(
-              Vector2Rotate(snake->movement_direction, PI/2),
-              snake->thickness * -0.5
-            )
-          ),
-          snake->thickness * 0.4, WHITE);
-      DrawCircleV(
-          Vector2Add(
-            Vector2Add(
-              pos,
-              Vector2Add(
-                Vector2Scale(
-                  snake->movement_direction,
-                  snake->thickness * 0.6
-                ),
-                Vector2Scale(
-                  snake->look_direction,
-                  snake->thickness * 0.2
-                )
-              )
-            ),
-            Vector2Scale(
-              Vector2Rotate(snake->movement_direction, PI/2),
-              snake->thickness * -0.5
-            )
-          ),
-          snake->thickness * 0.2, BLACK);
+void growSnakeBody(SnakeBody* body, int minCapacity) {
+  if (body->capacity >= minCapacity) return;
 
+  int capacity = body->capacity > 0 ? body->capacity : 64;
+  while (capacity < minCapacity) capacity *= 2;
 
-    }
-    i--;
+  // Unwrap into the new arrays so the tail lands at index 0
+  float* block = malloc(sizeof(float) * capacity * SNAKE_BODY_ARRAYS);
+  float** arrays[SNAKE_BODY_ARRAYS];
+  snakeBodyArrays(body, arrays);
+  for (int a = 0; a < SNAKE_BODY_ARRAYS; a++) {
+    float* array = block + a * capacity;
+    if (body->count > 0) unwrapSnakeArray(body, array, *arrays[a]);
   }
+  free(body->x);
+  for (int a = 0; a < SNAKE_BODY_ARRAYS; a++) *arrays[a] = block + a * capacity;
 
-
-  float triangle_size = 0.8;
-  float triangle_offset = 3;
-  DrawTriangle(
-      Vector2Add(
-        Vector2Add(
-          snake->head->pos,
-          Vector2Scale(snake->movement_direction, snake->thickness * triangle_offset)
-        ),
-        Vector2Rotate(
-          Vector2Scale(snake->movement_direction, snake->thickness * triangle_size),
-          -PI/2
-        )
-      ),
-      Vector2Add(
-        Vector2Add(
-          snake->head->pos,
-          Vector2Scale(snake->movement_direction, snake->thickness * triangle_offset)
-        ),
-        Vector2Rotate(
-          Vector2Scale(snake->movement_direction, snake->thickness * triangle_size),
-          PI/2
-        )
-      ),
-      Vector2Add(
-        snake->head->pos,
-        Vector2Scale(snake->movement_direction, snake->thickness * (triangle_offset + triangle_size))
-      ),
-      (Color){255,255,255,100}
-  );
+  snakeBodyStats.free += capacity - body->capacity;
+  snakeBodyStats.allocations++;
+  body->capacity = capacity;
+  body->start = 0;
 }
 
-int gamepad = 0;
+void freeSnakeBody(SnakeBody* body) {
+  snakeBodyStats.live -= body->count;
+  snakeBodyStats.free -= body->capacity - body->count;
+  free(body->x);
+  *body = (SnakeBody){0};
+}
 
-int screen_mainmenu() {
-    while (
-      !IsGamepadAvailable(gamepad) && 
-      gamepad > 0
-    ) gamepad--;
+// Remembers the current positions of parts [begin, end) as the previous
+// tick's
+void snapshotSnakeBodyRange(SnakeBody* body, int begin, int end) {
+  int n = end - begin;
+  int start = snakePartIndex(body, begin);
+  int first = body->capacity - start;
+  if (first > n) first = n;
+  memcpy(body->prev_x + start, body->x + start, sizeof(float) * first);
+  memcpy(body->prev_y + start, body->y + start, sizeof(float) * first);
+  memcpy(body->prev_x, body->x, sizeof(float) * (n - first));
+  memcpy(body->prev_y, body->y, sizeof(float) * (n - first));
+}
 
-    while (
-      IsGamepadAvailable(gamepad) && 
-      TextFindIndex(GetGamepadName(gamepad), "Touchpad") > -1
-    ) gamepad++;
+void snapshotSnakeBody(SnakeBody* body) {
+  snapshotSnakeBodyRange(body, 0, body->count);
+}
 
-    if (IsGamepadAvailable(gamepad)){
-      if (IsGamepadButtonPressed(gamepad, GAMEPAD_BUTTON_RIGHT_FACE_DOWN)) return 1;
-    }
-    else {
-      if (IsKeyPressed(KEY_ENTER)) return 1;
-    }
+void addSnakeFront(Snake* self, Vector2 pos, float length) {
+  SnakeBody* body = &self->body;
+  growSnakeBody(body, body->count + 1);
 
-    BeginDrawing();
-    ClearBackground(BLACK);
+  body->count++;
+  setSnakePart(body, body->count - 1, (SnakePart){pos, length});
+  countSnakeParts(1);
+}
 
-    if (IsGamepadAvailable(gamepad)){
-      DrawTextEx(
-        GetFontDefault(),
-        "Press A\n"
-        "to start",
-        (Vector2){50,150}, 36, 10, WHITE
-      );
-    }
-    else {
-      DrawTextEx(
-        GetFontDefault(),
-        "Press ENTER\n"
-        "to start",
-        (Vector2){50,150}, 36, 10, WHITE
-      );
-    }
+// Adds n parts behind the tail, growing the body at most once
+void addSnakeTailN(Snake* self, Vector2 pos, float length, int n) {
+  SnakeBody* body = &self->body;
+  growSnakeBody(body, body->count + n);
 
-    EndDrawing();
-    return 0;
+  body->start = (body->start - n) & (body->capacity - 1);
+  body->count += n;
+  for (int i = 0; i < n; i++) {
+    setSnakePart(body, i, (SnakePart){pos, length});
+  }
+  countSnakeParts(n);
 }
 
-void input_gamepad(Camera2D* camera, Snake* snake, float dt){
-  float targetZoom = 
-    1.0 +
-    (GetGamepadAxisMovement(gamepad, GAMEPAD_AXIS_LEFT_TRIGGER) + 1) / 2 *
-    ZOOM_MAX;
-  camera->zoom = Lerp(camera->zoom, targetZoom, dt / 0.2);
-
+void addSnakeTail(Snake* self, Vector2 pos, float length) {
+  addSnakeTailN(self, pos, length, 1);
+}
 
-  Vector2 temp_direction = (Vector2){
-    GetGamepadAxisMovement(gamepad, GAMEPAD_AXIS_LEFT_X),
-    GetGamepadAxisMovement(gamepad, GAMEPAD_AXIS_LEFT_Y)
-  };
+void popSnakeTail(Snake* self) {
+  SnakeBody* body = &self->body;
+  body->start = (body->start + 1) & (body->capacity - 1);
+  body->count--;
+  countSnakeParts(-1);
+}
 
-  snake->look_direction = (Vector2){
-    GetGamepadAxisMovement(gamepad, GAMEPAD_AXIS_RIGHT_X),
-    GetGamepadAxisMovement(gamepad, GAMEPAD_AXIS_RIGHT_Y)
-  };
+// The kernels below must round the same way in every lane width, or the
+// body would depend on --threads (each job's tail goes through the scalar
+// loop). With FMA available the compiler fuses a * b + c in the scalar loop
+// and the vector ones differently, so contraction is off for all of them.
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
 
-  if (Vector2Length(temp_direction) > DEADZONE) {
-   snake->movement_direction = Vector2Normalize(
-      Vector2Lerp(
-        snake->movement_direction,
-        temp_direction,
-        dt / 0.05
-      )
-    );
+// Follow-the-leader step for one contiguous run of n parts: every part that
+// is further than its length from its successor moves k of the way towards
+// it. The successor of part i is part i + 1, and (nextX, nextY) for the last
+// one. Successors are read before they are written, so the result does not
+// depend on how many lanes are processed at once.
+void followLeaderScalar(
+    float* x, float* y, const float* length, int n,
+    float nextX, float nextY, float k
+) {
+  for (int i = 0; i < n; i++) {
+    float nx = (i + 1 < n) ? x[i + 1] : nextX;
+    float ny = (i + 1 < n) ? y[i + 1] : nextY;
+    float dx = nx - x[i];
+    float dy = ny - y[i];
+    if (dx * dx + dy * dy > length[i] * length[i]) {
+      x[i] += dx * k;
+      y[i] += dy * k;
+    }
   }
+}
 
-  if (IsGamepadButtonPressed(gamepad, GAMEPAD_BUTTON_RIGHT_FACE_DOWN)) {
-    for (int i = 0; i < 10; i++) {
-      addSnakeTail(snake, snake->tail->pos, snake->tail->length);
-    }
+#if defined(__AVX__)
+#define FOLLOW_LANES 8
+
+void followLeader(
+    float* x, float* y, const float* length, int n,
+    float nextX, float nextY, float k
+) {
+  __m256 vk = _mm256_set1_ps(k);
+  int i = 0;
+  // x[i + 8] must exist, the last lanes fall through to the scalar loop
+  for (; i + FOLLOW_LANES < n; i += FOLLOW_LANES) {
+    __m256 px = _mm256_loadu_ps(x + i);
+    __m256 py = _mm256_loadu_ps(y + i);
+    __m256 len = _mm256_loadu_ps(length + i);
+    __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i + 1), px);
+    __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i + 1), py);
+    __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+    __m256 far = _mm256_cmp_ps(d2, _mm256_mul_ps(len, len), _CMP_GT_OQ);
+    __m256 kx = _mm256_and_ps(far, _mm256_mul_ps(dx, vk));
+    __m256 ky = _mm256_and_ps(far, _mm256_mul_ps(dy, vk));
+    _mm256_storeu_ps(x + i, _mm256_add_ps(px, kx));
+    _mm256_storeu_ps(y + i, _mm256_add_ps(py, ky));
   }
+  followLeaderScalar(x + i, y + i, length + i, n - i, nextX, nextY, k);
+}
+#elif defined(__SSE2__)
+#define FOLLOW_LANES 4
 
-  
-  if ( IsGamepadButtonDown(gamepad, GAMEPAD_BUTTON_RIGHT_FACE_RIGHT) &&
-       (snake->length > 10) ) {
-    //printf("boost %f && %d\n", snake->boost_time, snake->length);
-    if ( (snake->boost_time <= 0) && (snake->length > 10) ) {
-      snake->boost_time += 0.2;
-      popSnakeTail(snake);
-    }
+void followLeader(
+    float* x, float* y, const float* length, int n,
+    float nextX, float nextY, float k
+) {
+  __m128 vk = _mm_set1_ps(k);
+  int i = 0;
+  // x[i + 4] must exist, the last lanes fall through to the scalar loop
+  for (; i + FOLLOW_LANES < n; i += FOLLOW_LANES) {
+    __m128 px = _mm_loadu_ps(x + i);
+    __m128 py = _mm_loadu_ps(y + i);
+    __m128 len = _mm_loadu_ps(length + i);
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i + 1), px);
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i + 1), py);
+    __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+    __m128 far = _mm_cmpgt_ps(d2, _mm_mul_ps(len, len));
+    __m128 kx = _mm_and_ps(far, _mm_mul_ps(dx, vk));
+    __m128 ky = _mm_and_ps(far, _mm_mul_ps(dy, vk));
+    _mm_storeu_ps(x + i, _mm_add_ps(px, kx));
+    _mm_storeu_ps(y + i, _mm_add_ps(py, ky));
   }
-  
+  followLeaderScalar(x + i, y + i, length + i, n - i, nextX, nextY, k);
+}
+#else
+#define FOLLOW_LANES 1
 
-  //real_direction = input_direction;
-  
+void followLeader(
+    float* x, float* y, const float* length, int n,
+    float nextX, float nextY, float k
+) {
+  followLeaderScalar(x, y, length, n, nextX, nextY, k);
 }
+#endif
 
-void input_keymouse(Camera2D* camera, Snake* snake, float dt) {
-      float targetZoom = IsKeyDown(KEY_SPACE) ? ZOOM_MAX : 1.0;
-      camera->zoom = Lerp(camera->zoom, targetZoom, dt / 0.2);
+#pragma GCC pop_options
 
-      Vector2 temp_direction = Vector2Normalize(
-        Vector2Subtract(
-          GetMousePosition(),
-          (Vector2){GetRenderWidth()/2,GetRenderHeight()/2}
-        )
-      );
+// Runs followLeader over parts [begin, end), which must not include the
+// head. (nextX, nextY) is where part end was before this tick started. The
+// range can wrap around the ring, in which case it is two runs: the one
+// ending at the last slot follows slot 0, which still holds its old
+// position when it is read.
+void moveSnakeBodyRange(
+    SnakeBody* body, int begin, int end, float nextX, float nextY, float k
+) {
+  int n = end - begin;
+  if (n <= 0) return;
 
-      if (Vector2Length(temp_direction) > DEADZONE) {
-        snake->movement_direction = Vector2Normalize(
-          Vector2Lerp(
-            snake->movement_direction,
-            temp_direction,
-            dt * 20
-          )
-        );
-      }
+  int start = snakePartIndex(body, begin);
+  int first = body->capacity - start;
+  if (first >= n) {
+    followLeader(
+        body->x + start, body->y + start, body->length + start,
+        n, nextX, nextY, k
+    );
+    return;
+  }
 
-      snake->look_direction = (Vector2){0, 0};
-      if (IsKeyDown(KEY_W)) snake->look_direction = Vector2Add(
-          snake->look_direction, (Vector2){0, -1}
-        );
-      if (IsKeyDown(KEY_A)) snake->look_direction = Vector2Add(
-          snake->look_direction, (Vector2){-1, 0}
-        );
-      if (IsKeyDown(KEY_S)) snake->look_direction = Vector2Add(
-          snake->look_direction, (Vector2){0, 1}
-        );
-      if (IsKeyDown(KEY_D)) snake->look_direction = Vector2Add(
-          snake->look_direction, (Vector2){1, 0}
-        );
+  followLeader(
+      body->x + start, body->y + start, body->length + start,
+      first, body->x[0], body->y[0], k
+  );
+  followLeader(body->x, body->y, body->length, n - first, nextX, nextY, k);
+}
 
-      if (Vector2Length(snake->look_direction) > DEADZONE)
-        snake->look_direction = Vector2Normalize(snake->look_direction);
+// Every part except the head
+void moveSnakeBody(SnakeBody* body, float k) {
+  int n = body->count - 1;
+  if (n <= 0) return;
+  int head = snakePartIndex(body, n);
+  moveSnakeBodyRange(body, 0, n, body->x[head], body->y[head], k);
 }
 
-int main(){
-  InitWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Snake");
+void updateSnakeSpeed(Snake* self, float dt) {
+  float speed = SPEED;
+  if (self->boost_time > 0) {
+    speed *= BOOST;
+    self->boost_time -= dt;
+  }
+  self->current_speed = Lerp(self->current_speed, speed, dt / 0.2);
+}
 
-  // Load the shader
-  Shader background_shader = LoadShader("background.vs", "background.fs");
+void moveSnakeHead(Snake* self, float dt) {
+  SnakeBody* body = &self->body;
+  int head = snakePartIndex(body, body->count - 1);
+  body->x[head] += self->movement_direction.x * self->current_speed * dt;
+  body->y[head] += self->movement_direction.y * self->current_speed * dt;
+}
 
-  // Get the uniform locations
-  int mvpLoc = GetShaderLocation(background_shader, "mvp");
-  int resolutionLoc = GetShaderLocation(background_shader, "screenSize");
-  int cameraTransformLoc = GetShaderLocation(background_shader, "cameraTransform");
+// How far a part closes the gap to its successor in one tick. Past 1 it
+// overshoots, and past 2 every tick overshoots by more than the last, so
+// at the fixed tick (dt * SPEED = 2.5 at 60 Hz) it has to be clamped or the
+// body blows up to inf within a hundred ticks. The clamp makes body motion
+// depend on the tick rate: up to SPEED ticks a second every part jumps
+// onto its successor each tick, above that it only closes part of the gap
+// and the body trails more smoothly.
+float followGain(float dt) {
+  return fminf(dt * SPEED, 1);
+}
 
+void moveSnake(Snake* self, float dt) {
+  updateSnakeSpeed(self, dt);
+  moveSnakeBody(&self->body, followGain(dt));
+  moveSnakeHead(self, dt);
+}
 
-  Shader speedlines_shader = LoadShader(0, "speedlines.fs");
-  
-  // Get uniform locations
-  int iResolutionLoc = GetShaderLocation(speedlines_shader, "iResolution");
-  int iTimeLoc = GetShaderLocation(speedlines_shader, "iTime");
-  int radiusLoc = GetShaderLocation(speedlines_shader, "RADIUS");
+double nowSeconds();  // Defined with the profiler further down
 
-  float time = 0.0f;
+// Chrome trace events, one "complete" event per zone. Every thread records
+// into its own ring, which only it writes and only the writer thread reads,
+// so recording is two atomic loads and a store. A full ring drops events
+// rather than wait for the writer.
+#define TRACE_EVENTS 16384  // Per thread, power of two
+#define TRACE_THREADS 64    // Main thread plus job system workers
 
+typedef struct {
+  const char* name;
+  double begin;
+  double end;
+} TraceEvent;
 
-  int gamepad = 0;
+typedef struct {
+  TraceEvent events[TRACE_EVENTS];
+  atomic_uint head;  // Next slot to record into
+  atomic_uint tail;  // Next slot to write out
+} TraceBuffer;
 
-  Camera2D camera = {
-    .zoom = 1.0,
-    .offset = {0, 0},
-    .rotation = 0,
-    .target = {0, 0},
-  };
+typedef struct {
+  bool enabled;
+  atomic_bool running;
+  _Atomic(TraceBuffer*) buffers[TRACE_THREADS];  // Made by their thread on first use
+  FILE* file;
+  pthread_t writer;
+  double origin;
+  long written;
+  atomic_long dropped;
+} Tracer;
+
+Tracer tracer;
+
+// Index of the calling thread's buffer: 0 for the main thread, the worker
+// index for job system threads
+_Thread_local int traceThread;
+
+void traceEvent(const char* name, double begin, double end) {
+  if (!tracer.enabled) return;
+
+  TraceBuffer* buffer = atomic_load_explicit(&tracer.buffers[traceThread], memory_order_acquire);
+  if (buffer == NULL) {
+    buffer = calloc(1, sizeof(TraceBuffer));
+    atomic_store_explicit(&tracer.buffers[traceThread], buffer, memory_order_release);
+  }
+  unsigned int head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+  unsigned int tail = atomic_load_explicit(&buffer->tail, memory_order_acquire);
+  if (head - tail == TRACE_EVENTS) {
+    atomic_fetch_add_explicit(&tracer.dropped, 1, memory_order_relaxed);
+    return;
+  }
+  buffer->events[head & (TRACE_EVENTS - 1)] = (TraceEvent){name, begin, end};
+  atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
+}
+
+// Always -1 so TRACE_SCOPE runs its body once
+double traceEnd(const char* name, double t0) {
+  if (tracer.enabled) traceEvent(name, t0, nowSeconds());
+  return -1;
+}
+
+// Records the statement or block that follows as a zone. Same rules as
+// PROFILE_SCOPE.
+#define TRACE_SCOPE(name) \
+  for (double trace_t0 = tracer.enabled ? nowSeconds() : 0; trace_t0 >= 0; trace_t0 = traceEnd(name, trace_t0))
+
+// Writes out everything recorded so far, returns how many events
+int drainTraceBuffers() {
+  int drained = 0;
+  for (int t = 0; t < TRACE_THREADS; t++) {
+    TraceBuffer* buffer = atomic_load_explicit(&tracer.buffers[t], memory_order_acquire);
+    if (buffer == NULL) continue;
+
+    unsigned int tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+    for (; tail != head; tail++) {
+      TraceEvent* event = &buffer->events[tail & (TRACE_EVENTS - 1)];
+      fprintf(
+          tracer.file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+          tracer.written++ > 0 ? ",\n" : "", event->name, t,
+          (event->begin - tracer.origin) * 1e6, (event->end - event->begin) * 1e6
+      );
+      drained++;
+    }
+    atomic_store_explicit(&buffer->tail, tail, memory_order_release);
+  }
+  return drained;
+}
+
+void* traceWriterMain(void* arg) {
+  (void)arg;
+  for (;;) {
+    // Read before draining, so the last pass sees every event recorded
+    // before stopTrace
+    bool running = atomic_load(&tracer.running);
+    int drained = drainTraceBuffers();
+    if (!running) return NULL;
+    if (drained == 0) usleep(1000);
+  }
+}
+
+bool startTrace(const char* path) {
+  tracer.file = fopen(path, "w");
+  if (tracer.file == NULL) {
+    TraceLog(LOG_WARNING, "TRACE: could not write %s", path);
+    return false;
+  }
+  fprintf(tracer.file, "{\"traceEvents\":[\n");
+  tracer.origin = nowSeconds();
+  tracer.enabled = true;
+  atomic_store(&tracer.running, true);
+  pthread_create(&tracer.writer, NULL, traceWriterMain, NULL);
+  return true;
+}
+
+// Must run once every thread that records has stopped
+void stopTrace() {
+  if (!tracer.enabled) return;
+  atomic_store(&tracer.running, false);
+  pthread_join(tracer.writer, NULL);
+  tracer.enabled = false;
+
+  for (int t = 0; t < TRACE_THREADS; t++) {
+    TraceBuffer* buffer = atomic_load(&tracer.buffers[t]);
+    if (buffer == NULL) continue;
+    fprintf(
+        tracer.file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+        "\"args\":{\"name\":\"%s %d\"}}",
+        t, t == 0 ? "main" : "worker", t
+    );
+    free(buffer);
+    atomic_store(&tracer.buffers[t], NULL);
+  }
+  fprintf(tracer.file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  fclose(tracer.file);
+  TraceLog(
+      LOG_INFO, "TRACE: wrote %ld events, dropped %ld",
+      tracer.written, atomic_load(&tracer.dropped)
+  );
+}
+
+// Fixed pool of worker threads with one deque each. Jobs of a batch are
+// dealt round-robin; a worker pops from the bottom of its own deque and,
+// once that is empty, steals from the top of the others'. The calling
+// thread works as worker 0 and returns when the whole batch is done.
+#define MAX_WORKERS 64
+
+typedef void (*JobFn)(void* context, int job, int worker);
+
+typedef struct {
+  pthread_mutex_t lock;
+  int* jobs;
+  int top;
+  int bottom;
+  int capacity;
+} JobDeque;
+
+typedef struct JobSystem JobSystem;
+
+typedef struct {
+  JobSystem* system;
+  int index;
+} Worker;
+
+struct JobSystem {
+  int workers;
+  pthread_t threads[MAX_WORKERS];
+  Worker args[MAX_WORKERS];
+  JobDeque deques[MAX_WORKERS];
+
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  int batch;
+  bool quit;
+
+  JobFn fn;
+  void* context;
+  atomic_int remaining;
+  atomic_long steals;
+};
+
+void pushJob(JobDeque* deque, int job) {
+  pthread_mutex_lock(&deque->lock);
+  if (deque->bottom == deque->capacity) {
+    deque->capacity = deque->capacity ? deque->capacity * 2 : 64;
+    deque->jobs = realloc(deque->jobs, sizeof(int) * deque->capacity);
+  }
+  deque->jobs[deque->bottom++] = job;
+  pthread_mutex_unlock(&deque->lock);
+}
+
+// Owner end, newest job first. Returns -1 when empty.
+int popJob(JobDeque* deque) {
+  int job = -1;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->bottom > deque->top) job = deque->jobs[--deque->bottom];
+  if (deque->bottom == deque->top) deque->bottom = deque->top = 0;
+  pthread_mutex_unlock(&deque->lock);
+  return job;
+}
+
+// Thief end, oldest job first. Returns -1 when empty.
+int stealJob(JobDeque* deque) {
+  int job = -1;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->bottom > deque->top) job = deque->jobs[deque->top++];
+  if (deque->bottom == deque->top) deque->bottom = deque->top = 0;
+  pthread_mutex_unlock(&deque->lock);
+  return job;
+}
+
+void workOnBatch(JobSystem* system, int worker) {
+  while (atomic_load(&system->remaining) > 0) {
+    int job = popJob(&system->deques[worker]);
+    for (int v = 1; job < 0 && v < system->workers; v++) {
+      job = stealJob(&system->deques[(worker + v) % system->workers]);
+      if (job >= 0) atomic_fetch_add(&system->steals, 1);
+    }
+    if (job < 0) {
+      // Everything left is already running somewhere
+      sched_yield();
+      continue;
+    }
+    TRACE_SCOPE("job") system->fn(system->context, job, worker);
+    atomic_fetch_sub(&system->remaining, 1);
+  }
+}
+
+void* workerMain(void* arg) {
+  Worker* self = arg;
+  JobSystem* system = self->system;
+  int seen = 0;
+  traceThread = self->index;
+
+  for (;;) {
+    pthread_mutex_lock(&system->lock);
+    while (system->batch == seen && !system->quit) {
+      pthread_cond_wait(&system->wake, &system->lock);
+    }
+    seen = system->batch;
+    bool quit = system->quit;
+    pthread_mutex_unlock(&system->lock);
+    if (quit) return NULL;
+
+    workOnBatch(system, self->index);
+  }
+}
+
+void initJobSystem(JobSystem* system, int workers) {
+  *system = (JobSystem){0};
+  system->workers = Clamp(workers, 1, MAX_WORKERS);
+  pthread_mutex_init(&system->lock, NULL);
+  pthread_cond_init(&system->wake, NULL);
+  for (int w = 0; w < system->workers; w++) {
+    pthread_mutex_init(&system->deques[w].lock, NULL);
+  }
+  for (int w = 1; w < system->workers; w++) {
+    system->args[w] = (Worker){system, w};
+    pthread_create(&system->threads[w], NULL, workerMain, &system->args[w]);
+  }
+}
+
+void freeJobSystem(JobSystem* system) {
+  pthread_mutex_lock(&system->lock);
+  system->quit = true;
+  pthread_cond_broadcast(&system->wake);
+  pthread_mutex_unlock(&system->lock);
+
+  for (int w = 1; w < system->workers; w++) {
+    pthread_join(system->threads[w], NULL);
+  }
+  for (int w = 0; w < system->workers; w++) {
+    pthread_mutex_destroy(&system->deques[w].lock);
+    free(system->deques[w].jobs);
+  }
+  pthread_cond_destroy(&system->wake);
+  pthread_mutex_destroy(&system->lock);
+}
+
+// Runs fn(context, job, worker) for every job in [0, jobCount) and waits
+// for all of them
+void runJobs(JobSystem* system, int jobCount, JobFn fn, void* context) {
+  if (jobCount <= 0) return;
+  if (system->workers == 1) {
+    for (int job = 0; job < jobCount; job++) fn(context, job, 0);
+    return;
+  }
+
+  system->fn = fn;
+  system->context = context;
+  // Set before any job is visible: a worker still looping on the last batch
+  // can pop one of these and decrement the count straight away
+  atomic_store(&system->remaining, jobCount);
+  for (int job = 0; job < jobCount; job++) {
+    pushJob(&system->deques[job % system->workers], job);
+  }
+
+  pthread_mutex_lock(&system->lock);
+  system->batch++;
+  pthread_cond_broadcast(&system->wake);
+  pthread_mutex_unlock(&system->lock);
+
+  workOnBatch(system, 0);
+}
+
+int countCores() {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  return cores > 0 ? cores : 1;
+}
+
+double nowSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Where the time of a frame goes. A phase can run several times in one
+// frame, e.g. once per tick, and its times add up until profileEndFrame.
+typedef enum {
+  PHASE_INPUT,
+  PHASE_BOTS,
+  PHASE_MOVE,
+  PHASE_COLLIDE,
+  PHASE_FEED,
+  PHASE_CAMERA,
+  PHASE_BACKGROUND,
+  PHASE_WORLD,
+  PHASE_SPEEDLINES,
+  PHASE_PRESENT,
+  PHASE_FRAME,
+  PHASE_COUNT,
+} Phase;
+
+const char* PHASE_NAMES[PHASE_COUNT] = {
+  "input", "bots", "move", "collide", "feed", "camera",
+  "background", "world", "speedlines", "present", "frame",
+};
+
+#define PROFILE_FRAMES 256
+
+// Milliseconds per phase for the last PROFILE_FRAMES frames
+typedef struct {
+  float samples[PHASE_COUNT][PROFILE_FRAMES];
+  double current[PHASE_COUNT];
+  long frames;
+} Profiler;
+
+Profiler profiler;
+
+typedef struct {
+  float min;
+  float avg;
+  float p99;
+} PhaseStats;
+
+double profileBegin() {
+  return nowSeconds();
+}
 
-  Snake snake = {
-    .head = NULL,
-    .tail = NULL,
+// Always -1 so PROFILE_SCOPE runs its body once
+double profileEnd(Phase phase, double t0) {
+  double t1 = nowSeconds();
+  profiler.current[phase] += t1 - t0;
+  traceEvent(PHASE_NAMES[phase], t0, t1);
+  return -1;
+}
+
+// Times the statement or block that follows, and traces it as a zone.
+// Leaving it with break or return skips the sample. Scopes do not nest.
+#define PROFILE_SCOPE(phase) \
+  for (double profile_t0 = profileBegin(); profile_t0 >= 0; profile_t0 = profileEnd(phase, profile_t0))
+
+void profileEndFrame() {
+  int slot = profiler.frames % PROFILE_FRAMES;
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    profiler.samples[p][slot] = profiler.current[p] * 1e3;
+    profiler.current[p] = 0;
+  }
+  profiler.frames++;
+}
+
+int compareFloats(const void* a, const void* b) {
+  float x = *(const float*)a;
+  float y = *(const float*)b;
+  return (x > y) - (x < y);
+}
+
+PhaseStats profileStats(Phase phase) {
+  int n = profiler.frames < PROFILE_FRAMES ? profiler.frames : PROFILE_FRAMES;
+  if (n == 0) return (PhaseStats){0};
+
+  float sorted[PROFILE_FRAMES];
+  memcpy(sorted, profiler.samples[phase], sizeof(float) * n);
+  qsort(sorted, n, sizeof(float), compareFloats);
+  float sum = 0;
+  for (int i = 0; i < n; i++) sum += sorted[i];
+  return (PhaseStats){sorted[0], sum / n, sorted[(int)ceilf(n * 0.99f) - 1]};
+}
+
+void printProfile(FILE* out) {
+  fprintf(out, "%-12s %9s %9s %9s\n", "phase", "min ms", "avg ms", "p99 ms");
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    PhaseStats stats = profileStats(p);
+    fprintf(out, "%-12s %9.3f %9.3f %9.3f\n", PHASE_NAMES[p], stats.min, stats.avg, stats.p99);
+  }
+}
+
+// One row per frame still in the buffer, oldest first
+void writeProfileCsv(const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    TraceLog(LOG_WARNING, "PROFILE: could not write %s", path);
+    return;
+  }
+
+  fprintf(file, "index");
+  for (int p = 0; p < PHASE_COUNT; p++) fprintf(file, ",%s", PHASE_NAMES[p]);
+  fprintf(file, "\n");
+  long first = profiler.frames > PROFILE_FRAMES ? profiler.frames - PROFILE_FRAMES : 0;
+  for (long f = first; f < profiler.frames; f++) {
+    fprintf(file, "%ld", f);
+    for (int p = 0; p < PHASE_COUNT; p++) {
+      fprintf(file, ",%.4f", profiler.samples[p][f % PROFILE_FRAMES]);
+    }
+    fprintf(file, "\n");
+  }
+  fclose(file);
+  TraceLog(LOG_INFO, "PROFILE: wrote %ld frames to %s", profiler.frames - first, path);
+}
+
+void drawProfileOverlay() {
+  const int size = 10;
+  const int line = 12;
+  DrawRectangle(4, 4, 250, line * (PHASE_COUNT + 1) + 8, (Color){0, 0, 0, 160});
+  DrawText("phase", 8, 8, size, LIGHTGRAY);
+  DrawText("min", 100, 8, size, LIGHTGRAY);
+  DrawText("avg", 150, 8, size, LIGHTGRAY);
+  DrawText("p99", 200, 8, size, LIGHTGRAY);
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    PhaseStats stats = profileStats(p);
+    int y = 8 + line * (p + 1);
+    DrawText(PHASE_NAMES[p], 8, y, size, WHITE);
+    DrawText(TextFormat("%.2f", stats.min), 100, y, size, WHITE);
+    DrawText(TextFormat("%.2f", stats.avg), 150, y, size, WHITE);
+    DrawText(TextFormat("%.2f", stats.p99), 200, y, size, WHITE);
+  }
+}
+
+const float PART_LENGTH = 2;
+
+// Bots wander inside this radius around the origin and turn back at it
+const float ARENA_RADIUS = 5000;
+
+// Lays partCount parts PART_LENGTH apart, starting at tail and going along
+void initSnake(Snake* snake, Vector2 tail, Vector2 along, int partCount) {
+  *snake = (Snake){
+    .body = {0},
     .thickness = 10,
-    .length = 0,
     .look_direction = {0, 0},
     .movement_direction = {1, 0},
     .boost_time = 0,
     .current_speed = SPEED,
   };
-  int partCount = 50;
-  float initialLength = 100;
+  growSnakeBody(&snake->body, partCount);
   for (int i = 0; i < partCount; i++) {
     addSnakeFront(
-          &snake
-        , (Vector2){250, 100 + initialLength * i / partCount}
-        , initialLength / partCount
+          snake
+        , Vector2Add(tail, Vector2Scale(along, PART_LENGTH * i))
+        , PART_LENGTH
     );
   }
+}
+
+typedef struct {
+  int slot;
+  unsigned int generation;
+} SnakeHandle;
 
-  Vector2 velocity = {0, 0};
-  Vector2 input_direction = {0, 0};
+// Below this many parts a tick is cheaper than waking the workers
+#define PARALLEL_MIN_PARTS 16384
 
-  while(!WindowShouldClose()){
-    if (screen_mainmenu()) break;
+// Slice of one snake's body for a job to move. (nextX, nextY) is where
+// part end was when the tick started.
+typedef struct {
+  int slot;
+  int begin;
+  int end;
+  float nextX;
+  float nextY;
+} MoveSpan;
+
+// Scratch for moveWorld, rebuilt every tick. Job j moves spans
+// jobStart[j] to jobStart[j + 1].
+typedef struct {
+  MoveSpan* spans;
+  int spanCount;
+  int spanCapacity;
+  int* jobStart;
+  int jobCount;
+  int jobCapacity;
+  float k;
+} MovePlan;
+
+// Uniform grid over every part in the world, hashed into a flat table and
+// rebuilt each tick with a counting sort. Cells are as wide as the longest
+// head-to-part contact distance, so a head only has to look at its own
+// cell and the eight around it.
+typedef struct {
+  float cellSize;
+  int tableSize;     // Power of two
+  int* cellStart;    // tableSize + 1 offsets, bucket b is [cellStart[b], cellStart[b + 1])
+  int* cellCursor;   // Fill position per bucket during a rebuild
+  int* entrySlot;
+  int* entryPart;    // Logical part index within its snake
+  float* entryX;
+  float* entryY;
+  int entryCount;
+  int entryCapacity;
+} SpatialHash;
+
+void freeSpatialHash(SpatialHash* hash) {
+  free(hash->cellStart);
+  free(hash->cellCursor);
+  free(hash->entrySlot);
+  free(hash->entryPart);
+  free(hash->entryX);
+  free(hash->entryY);
+  *hash = (SpatialHash){0};
+}
+
+int spatialBucket(const SpatialHash* hash, int cx, int cy) {
+  unsigned int h = (unsigned int)cx * 73856093u ^ (unsigned int)cy * 19349663u;
+  return h & (hash->tableSize - 1);
+}
+
+int spatialCell(const SpatialHash* hash, float v) {
+  return (int)floorf(v / hash->cellSize);
+}
+
+// Head radius plus part radius, see renderSnake
+float contactDistance(const Snake* head, const Snake* part) {
+  return head->thickness * 1.2 + part->thickness;
+}
+
+#define PELLET_CHUNK 256
+#define PELLET_RADIUS 3
+// Pellets from dead snakes added to the field per tick, the rest wait
+#define DEATH_PELLETS_PER_TICK 8192
+
+// Food pellets of one PELLET_CHUNK square of the arena, x and y in one
+// block like SnakeBody. Order within a chunk means nothing, eaten pellets
+// are replaced by the last one.
+typedef struct {
+  float* x;
+  float* y;
+  int count;
+  int capacity;
+} PelletChunk;
+
+// Square grid of chunks covering the arena. Pellets eaten during a tick
+// are put back all at once at the end of it. Dead snakes' bodies are
+// copied whole into a queue and drained into the chunks a budget at a
+// time, so one huge death does not land on a single tick.
+typedef struct {
+  PelletChunk* chunks;
+  int side;          // Chunks per row and column
+  float origin;      // World x and y of chunk (0, 0)'s corner
+  int count;
+  int target;        // Pellets to keep in the field
+  long eaten;
+
+  float* deadX;      // Queue of pellets from dead snakes, [deadStart, deadEnd)
+  float* deadY;
+  int deadStart;
+  int deadEnd;
+  int deadCapacity;
+
+  long deathPellets;
+  int largestDeath;          // Parts of the longest snake turned to pellets
+  double largestDeathTime;   // Seconds spent queueing that snake
+  int largestDrain;          // Most pellets added in one tick's drain
+  double slowestDrainTime;   // Seconds of the slowest tick's drain
+} PelletField;
+
+void initPellets(PelletField* field, int target) {
+  int side = (int)ceilf(ARENA_RADIUS * 2 / PELLET_CHUNK);
+  *field = (PelletField){
+    .chunks = calloc(side * side, sizeof(PelletChunk)),
+    .side = side,
+    .origin = -side * PELLET_CHUNK * 0.5f,
+    .target = target,
+  };
+}
+
+void freePellets(PelletField* field) {
+  for (int c = 0; c < field->side * field->side; c++) free(field->chunks[c].x);
+  free(field->chunks);
+  free(field->deadX);
+  free(field->deadY);
+  *field = (PelletField){0};
+}
+
+void logPelletStats(const PelletField* field) {
+  TraceLog(
+      LOG_INFO, "PELLETS: %ld eaten, %ld from deaths, largest death %d parts queued in %.3f ms, "
+      "slowest drain %d pellets in %.3f ms",
+      field->eaten, field->deathPellets,
+      field->largestDeath, field->largestDeathTime * 1e3,
+      field->largestDrain, field->slowestDrainTime * 1e3
+  );
+}
+
+int pelletChunkCoord(const PelletField* field, float v) {
+  return (int)floorf((v - field->origin) / PELLET_CHUNK);
+}
+
+// Every snake in the game, the player included, in one array. Despawned
+// slots go on a free list for the next spawn, and their generation is
+// bumped so handles to the old snake stop resolving.
+typedef struct {
+  Snake* snakes;
+  unsigned int* generation;
+  bool* alive;
+  bool* dying;       // Scratch for collideWorld
+  bool* human;       // Steered by input rather than steerBots
+  float* turn;       // Bots' turn rate in radians per second
+  int* freeSlots;
+  int freeCount;
+  int slotCount;     // Slots handed out so far, only these are walked
+  int capacity;
+  int aliveCount;
+  int player;        // Slot driven by input, -1 when there is none
+  unsigned int seed; // xorshift32 state, a seed always plays out the same
+
+  int bots;          // Bots to keep alive, dead ones are replaced
+  long deaths;
+
+  JobSystem* jobs;   // NULL moves every snake on the calling thread
+  MovePlan plan;
+  SpatialHash hash;
+  PelletField pellets;
+} World;
+
+void initWorld(World* world, int capacity, unsigned int seed) {
+  *world = (World){
+    .snakes = malloc(sizeof(Snake) * capacity),
+    .generation = calloc(capacity, sizeof(unsigned int)),
+    .alive = calloc(capacity, sizeof(bool)),
+    .dying = calloc(capacity, sizeof(bool)),
+    .human = calloc(capacity, sizeof(bool)),
+    .turn = calloc(capacity, sizeof(float)),
+    .freeSlots = malloc(sizeof(int) * capacity),
+    .capacity = capacity,
+    .player = -1,
+    .seed = seed ? seed : 1,
+  };
+}
+
+void freeWorld(World* world) {
+  for (int s = 0; s < world->slotCount; s++) {
+    if (world->alive[s]) freeSnakeBody(&world->snakes[s].body);
   }
-  while(!WindowShouldClose()){
-    float dt = GetFrameTime();
-    time += dt;
+  free(world->snakes);
+  free(world->generation);
+  free(world->alive);
+  free(world->dying);
+  free(world->human);
+  free(world->turn);
+  free(world->freeSlots);
+  free(world->plan.spans);
+  free(world->plan.jobStart);
+  freeSpatialHash(&world->hash);
+  freePellets(&world->pellets);
+  *world = (World){0};
+}
 
-    
-    while (
-      !IsGamepadAvailable(gamepad) && 
-      gamepad > 0
-    ) gamepad--;
+// Uniform in [0, 1)
+float worldRandom(World* world) {
+  unsigned int x = world->seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  world->seed = x;
+  return (x >> 8) * (1.0f / 16777216);
+}
+
+SnakeHandle spawnSnake(World* world, Vector2 tail, Vector2 direction, int partCount) {
+  int slot;
+  if (world->freeCount > 0) {
+    slot = world->freeSlots[--world->freeCount];
+  }
+  else {
+    if (world->slotCount == world->capacity) {
+      int capacity = world->capacity * 2;
+      world->snakes = realloc(world->snakes, sizeof(Snake) * capacity);
+      world->generation = realloc(world->generation, sizeof(unsigned int) * capacity);
+      world->alive = realloc(world->alive, sizeof(bool) * capacity);
+      world->dying = realloc(world->dying, sizeof(bool) * capacity);
+      world->human = realloc(world->human, sizeof(bool) * capacity);
+      world->turn = realloc(world->turn, sizeof(float) * capacity);
+      world->freeSlots = realloc(world->freeSlots, sizeof(int) * capacity);
+      memset(world->generation + world->capacity, 0, sizeof(unsigned int) * world->capacity);
+      memset(world->alive + world->capacity, 0, sizeof(bool) * world->capacity);
+      world->capacity = capacity;
+    }
+    slot = world->slotCount++;
+  }
+
+  Snake* snake = &world->snakes[slot];
+  initSnake(snake, tail, direction, partCount);
+  snake->movement_direction = direction;
+  world->alive[slot] = true;
+  world->human[slot] = false;
+  world->turn[slot] = 0;
+  world->aliveCount++;
+  return (SnakeHandle){slot, world->generation[slot]};
+}
+
+void despawnSnake(World* world, int slot) {
+  freeSnakeBody(&world->snakes[slot].body);
+  world->alive[slot] = false;
+  world->generation[slot]++;
+  world->freeSlots[world->freeCount++] = slot;
+  world->aliveCount--;
+  if (world->player == slot) world->player = -1;
+}
+
+Snake* resolveSnake(World* world, SnakeHandle handle) {
+  if (handle.slot < 0 || handle.slot >= world->slotCount) return NULL;
+  if (!world->alive[handle.slot]) return NULL;
+  if (world->generation[handle.slot] != handle.generation) return NULL;
+  return &world->snakes[handle.slot];
+}
+
+Snake* worldPlayer(World* world) {
+  return world->player >= 0 ? &world->snakes[world->player] : NULL;
+}
+
+void spawnBots(World* world, int count, int partCount) {
+  for (int b = 0; b < count; b++) {
+    float angle = worldRandom(world) * 2 * PI;
+    float distance = sqrtf(worldRandom(world)) * ARENA_RADIUS;
+    float heading = worldRandom(world) * 2 * PI;
+    spawnSnake(
+        world,
+        (Vector2){cosf(angle) * distance, sinf(angle) * distance},
+        (Vector2){cosf(heading), sinf(heading)},
+        partCount
+    );
+  }
+}
+
+// Bots drift between left and right turns and head back to the middle of
+// the arena when they reach its edge
+void steerBots(World* world, float dt) {
+  for (int s = 0; s < world->slotCount; s++) {
+    if (!world->alive[s] || world->human[s]) continue;
+    Snake* snake = &world->snakes[s];
 
-    while (
-      IsGamepadAvailable(gamepad) && 
-      TextFindIndex(GetGamepadName(gamepad), "Touchpad") > -1
-    ) gamepad++;
+    world->turn[s] = Clamp(world->turn[s] + (worldRandom(world) - 0.5f) * 8 * dt, -2, 2);
+    Vector2 direction = Vector2Rotate(snake->movement_direction, world->turn[s] * dt);
 
-    if ( IsGamepadAvailable(gamepad) ) {
-      input_gamepad(&camera, &snake, dt);
+    Vector2 head = snakeHead(snake).pos;
+    if (Vector2LengthSqr(head) > ARENA_RADIUS * ARENA_RADIUS) {
+      direction = Vector2Lerp(direction, Vector2Normalize(Vector2Negate(head)), dt * 2);
     }
-    else {
-      input_keymouse(&camera, &snake, dt);
+    snake->movement_direction = Vector2Normalize(direction);
+  }
+}
+
+void addMoveSpan(MovePlan* plan, MoveSpan span) {
+  if (plan->spanCount == plan->spanCapacity) {
+    plan->spanCapacity = plan->spanCapacity ? plan->spanCapacity * 2 : 256;
+    plan->spans = realloc(plan->spans, sizeof(MoveSpan) * plan->spanCapacity);
+  }
+  plan->spans[plan->spanCount++] = span;
+}
+
+void closeMoveJob(MovePlan* plan) {
+  if (plan->jobCount + 2 > plan->jobCapacity) {
+    plan->jobCapacity = plan->jobCapacity ? plan->jobCapacity * 2 : 64;
+    plan->jobStart = realloc(plan->jobStart, sizeof(int) * plan->jobCapacity);
+  }
+  plan->jobStart[++plan->jobCount] = plan->spanCount;
+}
+
+// Cuts the bodies into jobs of about target parts each. Short snakes are
+// packed together and long ones are split, so one huge snake still spreads
+// over every worker.
+void planMoveSpans(World* world, long target) {
+  MovePlan* plan = &world->plan;
+  plan->spanCount = 0;
+  plan->jobCount = 0;
+  if (plan->jobCapacity == 0) {
+    plan->jobCapacity = 64;
+    plan->jobStart = malloc(sizeof(int) * plan->jobCapacity);
+  }
+  plan->jobStart[0] = 0;
+
+  long weight = 0;
+  for (int s = 0; s < world->slotCount; s++) {
+    if (!world->alive[s]) continue;
+    SnakeBody* body = &world->snakes[s].body;
+    int n = body->count - 1;
+
+    for (int begin = 0; begin < n; ) {
+      int end = begin + (target - weight) < n ? begin + (target - weight) : n;
+      int next = snakePartIndex(body, end);
+      addMoveSpan(plan, (MoveSpan){s, begin, end, body->x[next], body->y[next]});
+      weight += end - begin;
+      begin = end;
+      if (weight >= target) {
+        closeMoveJob(plan);
+        weight = 0;
+      }
     }
+  }
+  if (weight > 0) closeMoveJob(plan);
+}
 
-    moveSnake(&snake, dt);
+void moveSpansJob(void* context, int job, int worker) {
+  (void)worker;
+  World* world = context;
+  MovePlan* plan = &world->plan;
+  for (int s = plan->jobStart[job]; s < plan->jobStart[job + 1]; s++) {
+    MoveSpan* span = &plan->spans[s];
+    SnakeBody* body = &world->snakes[span->slot].body;
+    snapshotSnakeBodyRange(body, span->begin, span->end);
+    moveSnakeBodyRange(body, span->begin, span->end, span->nextX, span->nextY, plan->k);
+  }
+}
 
-    Vector2 sdiv2 = {GetRenderWidth()/2,GetRenderHeight()/2};
-    camera.target = Vector2Lerp(
-        camera.target,
-        Vector2Add(
-          Vector2Subtract(
-            snake.head->pos,
-            sdiv2
-          ),
-          Vector2Scale(
-            snake.look_direction,
-            200 / camera.zoom
-          )
-        ),
-        dt / 0.1
-    );
-    camera.offset = Vector2Scale(sdiv2, 1 - camera.zoom);
-    
+// One pass over every live snake: remember where it was for interpolation,
+// then move it. With a job system and enough parts the bodies are moved in
+// parallel. Heads and speeds are cheap and stay on this thread, and every
+// span's successor is read up front, so the result is the same bit for bit
+// whatever the worker count.
+void moveWorld(World* world, float dt) {
+  long parts = 0;
+  for (int s = 0; s < world->slotCount; s++) {
+    if (world->alive[s]) parts += world->snakes[s].body.count;
+  }
 
-    BeginDrawing();
+  if (world->jobs == NULL || world->jobs->workers == 1 || parts < PARALLEL_MIN_PARTS) {
+    for (int s = 0; s < world->slotCount; s++) {
+      if (!world->alive[s]) continue;
+      snapshotSnakeBody(&world->snakes[s].body);
+      moveSnake(&world->snakes[s], dt);
+    }
+    return;
+  }
 
-    // Draw background
-    ClearBackground((Color){7,5,13,255});
+  for (int s = 0; s < world->slotCount; s++) {
+    if (!world->alive[s]) continue;
+    SnakeBody* body = &world->snakes[s].body;
+    snapshotSnakeBodyRange(body, body->count - 1, body->count);
+    updateSnakeSpeed(&world->snakes[s], dt);
+  }
 
-    Vector2 resolution = { GetScreenWidth(), GetScreenHeight() };
-    SetShaderValue(background_shader, resolutionLoc, &resolution, SHADER_UNIFORM_VEC2);
-    SetShaderValueMatrix(background_shader, mvpLoc, GetCameraMatrix2D(camera));
-    SetShaderValueMatrix(background_shader, cameraTransformLoc, GetCameraMatrix2D(camera));
+  long target = parts / (world->jobs->workers * 4);
+  planMoveSpans(world, target > 1024 ? target : 1024);
+  world->plan.k = followGain(dt);
 
-    BeginShaderMode(background_shader);
-    DrawRectangle(0, 0, GetScreenWidth(), GetScreenHeight(), WHITE);
-    EndShaderMode();
+  for (int s = 0; s < world->slotCount; s++) {
+    if (world->alive[s]) moveSnakeHead(&world->snakes[s], dt);
+  }
 
-    
-    BeginMode2D(camera);
+  runJobs(world->jobs, world->plan.jobCount, moveSpansJob, world);
+}
 
-    renderSnake(&snake);
+void buildSpatialHash(SpatialHash* hash, World* world) {
+  int parts = 0;
+  float thickness = 0;
+  for (int s = 0; s < world->slotCount; s++) {
+    if (!world->alive[s]) continue;
+    parts += world->snakes[s].body.count;
+    thickness = fmaxf(thickness, world->snakes[s].thickness);
+  }
 
-    EndMode2D();
+  hash->cellSize = thickness * 2.2;
+  hash->entryCount = parts;
+  if (hash->entryCapacity < parts) {
+    hash->entryCapacity = parts * 2;
+    hash->entrySlot = realloc(hash->entrySlot, sizeof(int) * hash->entryCapacity);
+    hash->entryPart = realloc(hash->entryPart, sizeof(int) * hash->entryCapacity);
+    hash->entryX = realloc(hash->entryX, sizeof(float) * hash->entryCapacity);
+    hash->entryY = realloc(hash->entryY, sizeof(float) * hash->entryCapacity);
+  }
+  int tableSize = 1024;
+  while (tableSize < parts * 2) tableSize *= 2;
+  if (hash->tableSize != tableSize) {
+    hash->tableSize = tableSize;
+    hash->cellStart = realloc(hash->cellStart, sizeof(int) * (tableSize + 1));
+    hash->cellCursor = realloc(hash->cellCursor, sizeof(int) * tableSize);
+  }
 
-    // Speedlines during boost
-    if ((snake.current_speed / SPEED) > 1.1) {
-      SetShaderValue(
-          speedlines_shader,
-          iResolutionLoc,
-          &(Vector2){GetScreenWidth(),GetScreenHeight()},
-          SHADER_UNIFORM_VEC2
+  // Count per bucket, prefix sum, then scatter
+  memset(hash->cellStart, 0, sizeof(int) * (hash->tableSize + 1));
+  for (int s = 0; s < world->slotCount; s++) {
+    if (!world->alive[s]) continue;
+    SnakeBody* body = &world->snakes[s].body;
+    for (int p = 0; p < body->count; p++) {
+      int j = snakePartIndex(body, p);
+      int bucket = spatialBucket(
+          hash, spatialCell(hash, body->x[j]), spatialCell(hash, body->y[j])
       );
-      SetShaderValue(speedlines_shader, iTimeLoc, &time, SHADER_UNIFORM_FLOAT);
-      const float radius_min = 0.65;
-      float radius = 
-        (SPEED * BOOST - snake.current_speed) / (SPEED * BOOST - SPEED) *
-        (M_SQRT2 - radius_min) + radius_min;
-      SetShaderValue(
-          speedlines_shader,
-          radiusLoc,
-          &radius,
-          SHADER_UNIFORM_FLOAT
+      hash->cellStart[bucket + 1]++;
+    }
+  }
+  for (int b = 0; b < hash->tableSize; b++) {
+    hash->cellStart[b + 1] += hash->cellStart[b];
+  }
+  memcpy(hash->cellCursor, hash->cellStart, sizeof(int) * hash->tableSize);
+  for (int s = 0; s < world->slotCount; s++) {
+    if (!world->alive[s]) continue;
+    SnakeBody* body = &world->snakes[s].body;
+    for (int p = 0; p < body->count; p++) {
+      int j = snakePartIndex(body, p);
+      int bucket = spatialBucket(
+          hash, spatialCell(hash, body->x[j]), spatialCell(hash, body->y[j])
       );
-      BeginShaderMode(speedlines_shader);
-      DrawRectangle(0, 0, GetScreenWidth(), GetScreenHeight(), WHITE);
-      EndShaderMode();
+      int e = hash->cellCursor[bucket]++;
+      hash->entrySlot[e] = s;
+      hash->entryPart[e] = p;
+      hash->entryX[e] = body->x[j];
+      hash->entryY[e] = body->y[j];
+    }
+  }
+}
+
+// Whether the snake's head touches any part of another snake
+bool headCollides(World* world, int slot) {
+  SpatialHash* hash = &world->hash;
+  Snake* snake = &world->snakes[slot];
+  Vector2 head = snakeHead(snake).pos;
+  int cx = spatialCell(hash, head.x);
+  int cy = spatialCell(hash, head.y);
+
+  for (int dy = -1; dy <= 1; dy++) {
+    for (int dx = -1; dx <= 1; dx++) {
+      int bucket = spatialBucket(hash, cx + dx, cy + dy);
+      for (int e = hash->cellStart[bucket]; e < hash->cellStart[bucket + 1]; e++) {
+        int other = hash->entrySlot[e];
+        if (other == slot) continue;
+        float reach = contactDistance(snake, &world->snakes[other]);
+        float ex = hash->entryX[e] - head.x;
+        float ey = hash->entryY[e] - head.y;
+        if (ex * ex + ey * ey < reach * reach) return true;
+      }
     }
+  }
+  return false;
+}
 
-    EndDrawing();
+// Copies the whole body onto the field's death queue, two memcpys per
+// array at most. The pellets reach the chunks in drainDeathPellets.
+void queueSnakePellets(PelletField* field, const Snake* snake) {
+  double t0 = nowSeconds();
+  const SnakeBody* body = &snake->body;
+
+  int queued = field->deadEnd - field->deadStart;
+  if (field->deadEnd + body->count > field->deadCapacity) {
+    // Slide what is left to the front, then grow if that is not enough
+    memmove(field->deadX, field->deadX + field->deadStart, sizeof(float) * queued);
+    memmove(field->deadY, field->deadY + field->deadStart, sizeof(float) * queued);
+    field->deadStart = 0;
+    field->deadEnd = queued;
+    if (queued + body->count > field->deadCapacity) {
+      int capacity = field->deadCapacity > 0 ? field->deadCapacity : 1024;
+      while (capacity < queued + body->count) capacity *= 2;
+      field->deadX = realloc(field->deadX, sizeof(float) * capacity);
+      field->deadY = realloc(field->deadY, sizeof(float) * capacity);
+      field->deadCapacity = capacity;
+    }
+  }
+  unwrapSnakeArray(body, field->deadX + field->deadEnd, body->x);
+  unwrapSnakeArray(body, field->deadY + field->deadEnd, body->y);
+  field->deadEnd += body->count;
+  field->deathPellets += body->count;
+
+  double elapsed = nowSeconds() - t0;
+  if (body->count > field->largestDeath) {
+    field->largestDeath = body->count;
+    field->largestDeathTime = elapsed;
+  }
+}
+
+// Kills every snake whose head ran into another snake this tick and turns
+// its body into food. All heads are tested against the same grid before
+// anyone is removed, so two snakes meeting head on both die. Returns the
+// number killed.
+int collideWorld(World* world) {
+  buildSpatialHash(&world->hash, world);
+
+  int deaths = 0;
+  for (int s = 0; s < world->slotCount; s++) {
+    world->dying[s] = world->alive[s] && headCollides(world, s);
   }
+  for (int s = 0; s < world->slotCount; s++) {
+    if (!world->dying[s]) continue;
+    queueSnakePellets(&world->pellets, &world->snakes[s]);
+    despawnSnake(world, s);
+    deaths++;
+  }
+  world->deaths += deaths;
+  return deaths;
+}
+
+void growPelletChunk(PelletChunk* chunk, int minCapacity) {
+  if (chunk->capacity >= minCapacity) return;
+
+  int capacity = chunk->capacity > 0 ? chunk->capacity : 64;
+  while (capacity < minCapacity) capacity *= 2;
+
+  float* block = malloc(sizeof(float) * capacity * 2);
+  memcpy(block, chunk->x, sizeof(float) * chunk->count);
+  memcpy(block + capacity, chunk->y, sizeof(float) * chunk->count);
+  free(chunk->x);
+  chunk->x = block;
+  chunk->y = block + capacity;
+  chunk->capacity = capacity;
+}
+
+// Moves up to DEATH_PELLETS_PER_TICK pellets from the death queue into the
+// chunks. Neighbouring parts mostly share a chunk, so the queue is copied
+// in runs that grow their chunk once each.
+void drainDeathPellets(PelletField* field) {
+  int n = field->deadEnd - field->deadStart;
+  if (n > DEATH_PELLETS_PER_TICK) n = DEATH_PELLETS_PER_TICK;
+  if (n == 0) return;
+  double t0 = nowSeconds();
+
+  const float* x = field->deadX + field->deadStart;
+  const float* y = field->deadY + field->deadStart;
+  for (int i = 0; i < n;) {
+    int cx = Clamp(pelletChunkCoord(field, x[i]), 0, field->side - 1);
+    int cy = Clamp(pelletChunkCoord(field, y[i]), 0, field->side - 1);
+    int run = i + 1;
+    while (run < n &&
+           Clamp(pelletChunkCoord(field, x[run]), 0, field->side - 1) == cx &&
+           Clamp(pelletChunkCoord(field, y[run]), 0, field->side - 1) == cy) {
+      run++;
+    }
+
+    PelletChunk* chunk = &field->chunks[cy * field->side + cx];
+    growPelletChunk(chunk, chunk->count + run - i);
+    memcpy(chunk->x + chunk->count, x + i, sizeof(float) * (run - i));
+    memcpy(chunk->y + chunk->count, y + i, sizeof(float) * (run - i));
+    chunk->count += run - i;
+    i = run;
+  }
+  field->count += n;
+  field->deadStart += n;
+  if (field->deadStart == field->deadEnd) field->deadStart = field->deadEnd = 0;
+
+  double elapsed = nowSeconds() - t0;
+  if (elapsed > field->slowestDrainTime) {
+    field->slowestDrainTime = elapsed;
+    field->largestDrain = n;
+  }
+}
+
+// Drops count pellets at random points of the arena
+void spawnPellets(World* world, PelletField* field, int count) {
+  for (int p = 0; p < count; p++) {
+    float angle = worldRandom(world) * 2 * PI;
+    float distance = sqrtf(worldRandom(world)) * ARENA_RADIUS;
+    float x = cosf(angle) * distance;
+    float y = sinf(angle) * distance;
+    int cx = Clamp(pelletChunkCoord(field, x), 0, field->side - 1);
+    int cy = Clamp(pelletChunkCoord(field, y), 0, field->side - 1);
+
+    PelletChunk* chunk = &field->chunks[cy * field->side + cx];
+    growPelletChunk(chunk, chunk->count + 1);
+    chunk->x[chunk->count] = x;
+    chunk->y[chunk->count] = y;
+    chunk->count++;
+  }
+  if (count > 0) field->count += count;
+}
+
+// Eats every pellet within reach of the snake's head and returns how many.
+// Only the chunks the reach overlaps are looked at.
+int eatPellets(PelletField* field, const Snake* snake) {
+  Vector2 head = snakeHead(snake).pos;
+  float reach = snake->thickness * 1.2 + PELLET_RADIUS;
+  int x0 = Clamp(pelletChunkCoord(field, head.x - reach), 0, field->side - 1);
+  int x1 = Clamp(pelletChunkCoord(field, head.x + reach), 0, field->side - 1);
+  int y0 = Clamp(pelletChunkCoord(field, head.y - reach), 0, field->side - 1);
+  int y1 = Clamp(pelletChunkCoord(field, head.y + reach), 0, field->side - 1);
+
+  int eaten = 0;
+  for (int cy = y0; cy <= y1; cy++) {
+    for (int cx = x0; cx <= x1; cx++) {
+      PelletChunk* chunk = &field->chunks[cy * field->side + cx];
+      for (int i = 0; i < chunk->count; i++) {
+        float dx = chunk->x[i] - head.x;
+        float dy = chunk->y[i] - head.y;
+        if (dx * dx + dy * dy >= reach * reach) continue;
+        chunk->count--;
+        chunk->x[i] = chunk->x[chunk->count];
+        chunk->y[i] = chunk->y[chunk->count];
+        i--;
+        eaten++;
+      }
+    }
+  }
+  field->count -= eaten;
+  field->eaten += eaten;
+  return eaten;
+}
+
+// Grows every snake by a part per pellet it ate this tick, then adds this
+// tick's share of dead snakes and tops the field back up to its target,
+// each in one batch
+void feedWorld(World* world) {
+  PelletField* field = &world->pellets;
+  for (int s = 0; s < world->slotCount; s++) {
+    if (!world->alive[s]) continue;
+    Snake* snake = &world->snakes[s];
+    int eaten = eatPellets(field, snake);
+    if (eaten > 0) addSnakeTailN(snake, snakeTail(snake).pos, PART_LENGTH, eaten);
+  }
+  drainDeathPellets(field);
+  spawnPellets(world, field, field->target - field->count);
+}
+
+const Color SNAKE_PALETTE[] =
+  {
+    {250, .a = 255},
+    {250, .a = 255},
+    {250, .a = 255},
+    {250, .a = 255},
+    {250, .a = 255},
+    {250, .a = 255},
+    {250, .a = 255},
+    {250, .a = 255},
+    WHITE,
+  };
+#define SNAKE_PALETTE_SIZE (int)(sizeof(SNAKE_PALETTE) / sizeof(Color))
+
+const Color PELLET_PALETTE[] = {
+  {255, 120, 120, 255},
+  {120, 255, 160, 255},
+  {120, 170, 255, 255},
+  {255, 220, 110, 255},
+};
+
+#define PELLET_PALETTE_SIZE (int)(sizeof(PELLET_PALETTE) / sizeof(Color))
+
+#define CIRCLE_SEGMENTS 24
+
+// The tube's points go in a float texture this many texels wide, as many
+// rows as the longest body needs. The shader walks every point for every
+// pixel it covers, so its cost grows with body length times covered area.
+#define TUBE_TEXTURE_WIDTH 1024
+
+typedef enum {
+  BODY_RENDER_INSTANCED, // One instanced quad per part, circle cut in snakebody.fs
+  BODY_RENDER_CIRCLES,   // Triangle fans from a unit circle built once
+  BODY_RENDER_TUBE,      // One quad over the body, capsule chain in snaketube.fs
+} BodyRenderMode;
+
+typedef struct {
+  BodyRenderMode mode;
+
+  // Instanced quads: the body in instanced mode, pellets in instanced and
+  // tube mode
+  Shader shader;
+  Material material;
+  Mesh quad;
+  Matrix* transforms;
+  int transformCapacity;
+  int instanceCount;
+
+  Shader tubeShader;
+  Texture2D polyline;
+  int pointCountLoc;
+  int thicknessLoc;
+  int polylineLoc;
+  Vector4* points;
+  int pointCapacity;   // Whole texture rows
+
+  // Fan points of a unit circle, center first, in DrawCircleV's winding
+  Vector2 unitCircle[CIRCLE_SEGMENTS + 2];
+  Vector2 fan[CIRCLE_SEGMENTS + 2];
+} BodyRenderer;
+
+// Two triangles spanning [-1, 1] on x and y, texcoords [0, 1]. Wound the
+// same way as DrawRectangle so backface culling keeps them.
+Mesh genQuadMesh() {
+  const float corners[6][2] = {{-1,-1}, {-1,1}, {1,1}, {-1,-1}, {1,1}, {1,-1}};
+  Mesh mesh = {0};
+  mesh.vertexCount = 6;
+  mesh.triangleCount = 2;
+  mesh.vertices = calloc(mesh.vertexCount * 3, sizeof(float));
+  mesh.texcoords = calloc(mesh.vertexCount * 2, sizeof(float));
+  for (int v = 0; v < mesh.vertexCount; v++) {
+    mesh.vertices[v * 3 + 0] = corners[v][0];
+    mesh.vertices[v * 3 + 1] = corners[v][1];
+    mesh.texcoords[v * 2 + 0] = (corners[v][0] + 1) / 2;
+    mesh.texcoords[v * 2 + 1] = (corners[v][1] + 1) / 2;
+  }
+  UploadMesh(&mesh, false);
+  return mesh;
+}
+
+void setShaderPalette(Shader shader, const Vector4* palette, int size) {
+  SetShaderValue(shader, GetShaderLocation(shader, "paletteSize"), &size, SHADER_UNIFORM_INT);
+  SetShaderValueV(shader, GetShaderLocation(shader, "palette"), palette, SHADER_UNIFORM_VEC4, size);
+}
+
+void loadBodyRenderer(BodyRenderer* renderer, BodyRenderMode mode) {
+  *renderer = (BodyRenderer){ .mode = mode };
+
+  renderer->unitCircle[0] = (Vector2){0, 0};
+  for (int s = 0; s <= CIRCLE_SEGMENTS; s++) {
+    float angle = 2 * PI * (CIRCLE_SEGMENTS - s) / CIRCLE_SEGMENTS;
+    renderer->unitCircle[s + 1] = (Vector2){cosf(angle), sinf(angle)};
+  }
+
+  if (mode == BODY_RENDER_CIRCLES) return;
+
+  // A shader that fails to build comes back as raylib's default one, which
+  // has no instanceTransform attribute
+  renderer->shader = LoadShader("snakebody.vs", "snakebody.fs");
+  int instanceLoc = GetShaderLocationAttrib(renderer->shader, "instanceTransform");
+  if (!IsShaderValid(renderer->shader) || instanceLoc < 0) {
+    TraceLog(LOG_WARNING, "snakebody shader failed, drawing body with triangle fans");
+    UnloadShader(renderer->shader);
+    renderer->mode = BODY_RENDER_CIRCLES;
+    return;
+  }
+  renderer->shader.locs[SHADER_LOC_MATRIX_MVP] = GetShaderLocation(renderer->shader, "mvp");
+  renderer->shader.locs[SHADER_LOC_MATRIX_MODEL] = instanceLoc;
+
+  renderer->material = LoadMaterialDefault();
+  renderer->material.shader = renderer->shader;
+  renderer->quad = genQuadMesh();
+
+  // Snake colours first so part indices need no offset, pellet colours
+  // after them
+  Vector4 palette[SNAKE_PALETTE_SIZE + PELLET_PALETTE_SIZE];
+  for (int c = 0; c < SNAKE_PALETTE_SIZE; c++) {
+    palette[c] = ColorNormalize(SNAKE_PALETTE[c]);
+  }
+  for (int c = 0; c < PELLET_PALETTE_SIZE; c++) {
+    palette[SNAKE_PALETTE_SIZE + c] = ColorNormalize(PELLET_PALETTE[c]);
+  }
+  setShaderPalette(renderer->shader, palette, SNAKE_PALETTE_SIZE + PELLET_PALETTE_SIZE);
+
+  if (mode == BODY_RENDER_TUBE) {
+    renderer->tubeShader = LoadShader("snaketube.vs", "snaketube.fs");
+    renderer->polylineLoc = GetShaderLocation(renderer->tubeShader, "polyline");
+    if (!IsShaderValid(renderer->tubeShader) || renderer->polylineLoc < 0) {
+      TraceLog(LOG_WARNING, "snaketube shader failed, drawing body with instanced quads");
+      UnloadShader(renderer->tubeShader);
+      renderer->mode = BODY_RENDER_INSTANCED;
+      return;
+    }
+    renderer->pointCountLoc = GetShaderLocation(renderer->tubeShader, "pointCount");
+    renderer->thicknessLoc = GetShaderLocation(renderer->tubeShader, "thickness");
+    setShaderPalette(renderer->tubeShader, palette, SNAKE_PALETTE_SIZE);
+  }
+}
+
+void unloadBodyRenderer(BodyRenderer* renderer) {
+  free(renderer->transforms);
+  if (renderer->mode == BODY_RENDER_CIRCLES) return;
+  UnloadMesh(renderer->quad);
+  UnloadMaterial(renderer->material); // Also unloads the shader
+  if (renderer->mode == BODY_RENDER_TUBE) {
+    if (renderer->pointCapacity > 0) UnloadTexture(renderer->polyline);
+    free(renderer->points);
+    UnloadShader(renderer->tubeShader);
+  }
+}
+
+// Grows the polyline texture to hold count points, a whole row at a time
+void reserveTubePoints(BodyRenderer* renderer, int count) {
+  if (count <= renderer->pointCapacity) return;
+  int rows = (count + TUBE_TEXTURE_WIDTH - 1) / TUBE_TEXTURE_WIDTH;
+  if (renderer->pointCapacity > 0) UnloadTexture(renderer->polyline);
+  renderer->pointCapacity = rows * TUBE_TEXTURE_WIDTH;
+  renderer->points = realloc(renderer->points, sizeof(Vector4) * renderer->pointCapacity);
+
+  Image image = {
+    .data = renderer->points,
+    .width = TUBE_TEXTURE_WIDTH,
+    .height = rows,
+    .mipmaps = 1,
+    .format = PIXELFORMAT_UNCOMPRESSED_R32G32B32A32,
+  };
+  renderer->polyline = LoadTextureFromImage(image);
+}
+
+// Room for count more instances in the next instanced draw
+Matrix* queueInstances(BodyRenderer* renderer, int count) {
+  int needed = renderer->instanceCount + count;
+  if (renderer->transformCapacity < needed) {
+    renderer->transformCapacity = needed * 2;
+    renderer->transforms = realloc(
+        renderer->transforms, sizeof(Matrix) * renderer->transformCapacity
+    );
+  }
+  Matrix* transforms = renderer->transforms + renderer->instanceCount;
+  renderer->instanceCount = needed;
+  return transforms;
+}
+
+// Adds every part but the head to the next instanced draw. The palette
+// index rides in the transform's z column, which a flat quad never reads.
+void queueSnakeBodyInstances(BodyRenderer* renderer, Snake* snake, float alpha) {
+  SnakeBody* body = &snake->body;
+  int parts = body->count - 1;
+  if (parts <= 0) return;
+
+  Matrix* transforms = queueInstances(renderer, parts);
+  for (int p = 0; p < parts; p++) {
+    Vector2 pos = snakePartLerp(body, p, alpha);
+    transforms[p] = (Matrix){
+      .m0 = snake->thickness, .m5 = snake->thickness, .m10 = 1, .m15 = 1,
+      .m12 = pos.x, .m13 = pos.y,
+      .m8 = (body->count - 1 - p) % SNAKE_PALETTE_SIZE,
+    };
+  }
+}
+
+// Draws everything queued in one call. Must run inside BeginMode2D, it
+// picks the camera up from rlgl's current matrices.
+void flushBodyInstances(BodyRenderer* renderer) {
+  if (renderer->instanceCount == 0) return;
+  DrawMeshInstanced(
+      renderer->quad, renderer->material, renderer->transforms, renderer->instanceCount
+  );
+  renderer->instanceCount = 0;
+}
+
+// Every part but the head as one capsule chain, drawn as a single quad over
+// the body's bounds. Every part is uploaded, so long bodies keep their
+// shape but cost proportionally more per pixel.
+void renderSnakeBodyTube(BodyRenderer* renderer, Snake* snake, float alpha) {
+  SnakeBody* body = &snake->body;
+  int parts = body->count - 1;
+  if (parts <= 0) return;
+
+  // A single point still needs a segment to make a capsule
+  int pointCount = parts > 1 ? parts : 2;
+  reserveTubePoints(renderer, pointCount);
+  Vector2 min = { INFINITY, INFINITY };
+  Vector2 max = { -INFINITY, -INFINITY };
+  for (int p = 0; p < parts; p++) {
+    Vector2 pos = snakePartLerp(body, p, alpha);
+    renderer->points[p] = (Vector4){pos.x, pos.y, body->count - 1 - p, 0};
+    min = Vector2Min(min, pos);
+    max = Vector2Max(max, pos);
+  }
+  if (parts == 1) renderer->points[1] = renderer->points[0];
+
+  int rows = (pointCount + TUBE_TEXTURE_WIDTH - 1) / TUBE_TEXTURE_WIDTH;
+  UpdateTextureRec(
+      renderer->polyline, (Rectangle){0, 0, TUBE_TEXTURE_WIDTH, rows}, renderer->points
+  );
+  SetShaderValue(renderer->tubeShader, renderer->pointCountLoc, &pointCount, SHADER_UNIFORM_INT);
+  SetShaderValue(renderer->tubeShader, renderer->thicknessLoc, &snake->thickness, SHADER_UNIFORM_FLOAT);
+  SetShaderValueTexture(renderer->tubeShader, renderer->polylineLoc, renderer->polyline);
+
+  float margin = snake->thickness + 1;
+  BeginShaderMode(renderer->tubeShader);
+  DrawRectangleRec(
+      (Rectangle){
+        min.x - margin, min.y - margin,
+        max.x - min.x + 2 * margin, max.y - min.y + 2 * margin
+      },
+      WHITE
+  );
+  EndShaderMode();
+}
+
+void drawUnitCircle(BodyRenderer* renderer, Vector2 center, float radius, Color color) {
+  for (int s = 0; s < CIRCLE_SEGMENTS + 2; s++) {
+    renderer->fan[s] = Vector2Add(center, Vector2Scale(renderer->unitCircle[s], radius));
+  }
+  DrawTriangleFan(renderer->fan, CIRCLE_SEGMENTS + 2, color);
+}
+
+// Draws one snake. In instanced mode the body is left to renderWorld,
+// which batches every snake's parts together.
+void renderSnake(BodyRenderer* renderer, Snake* snake, float alpha) {
+  SnakeBody* body = &snake->body;
+  int i = body->count - 1;
+  const Color* colors = SNAKE_PALETTE;
+  int colorCount = SNAKE_PALETTE_SIZE;
+
+  bool circles = renderer->mode == BODY_RENDER_CIRCLES;
+  if (renderer->mode == BODY_RENDER_TUBE) {
+    renderSnakeBodyTube(renderer, snake, alpha);
+  }
+
+  for (int p = 0; p < body->count; p++) {
+    Vector2 pos = snakePartLerp(body, p, alpha);
+    
+    int colorIndex = i % colorCount;
+
+    if (p < body->count - 1) {
+      if (circles) drawUnitCircle(renderer, pos, snake->thickness, colors[colorIndex]);
+    }
+    else {
+      // Head
+      DrawCircleV(pos, snake->thickness * 1.2, colors[colorIndex]);
+
+      // Right Eye
+      DrawCircleV(
+          Vector2Add(
+            Vector2Add(
+              pos,
+              Vector2Scale(snake->movement_direction, snake->thickness * 0.6)
+            ),
+            Vector2Scale(
+              Vector2Rotate(snake->movement_direction, PI/2),
+              snake->thickness * 0.5
+            )
+          ),
+          snake->thickness * 0.4, WHITE);
+      DrawCircleV(
+          Vector2Add(
+            Vector2Add(
+              pos,
+              Vector2Add(
+                Vector2Scale(
+                  snake->movement_direction,
+                  snake->thickness * 0.6
+                ),
+                Vector2Scale(
+                  snake->look_direction,
+                  snake->thickness * 0.2
+                )
+              )
+            ),
+            Vector2Scale(
+              Vector2Rotate(snake->movement_direction, PI/2),
+              snake->thickness * 0.5
+            )
+          ),
+          snake->thickness * 0.2, BLACK);
+
+      // Left Eye
+      DrawCircleV(
+          Vector2Add(
+            Vector2Add(
+              pos,
+              Vector2Scale(snake->movement_direction, snake->thickness * 0.6)
+            ),
+            Vector2Scale(
+              Vector2Rotate(snake->movement_direction, PI/2),
+              snake->thickness * -0.5
+            )
+          ),
+          snake->thickness * 0.4, WHITE);
+      DrawCircleV(
+          Vector2Add(
+            Vector2Add(
+              pos,
+              Vector2Add(
+                Vector2Scale(
+                  snake->movement_direction,
+                  snake->thickness * 0.6
+                ),
+                Vector2Scale(
+                  snake->look_direction,
+                  snake->thickness * 0.2
+                )
+              )
+            ),
+            Vector2Scale(
+              Vector2Rotate(snake->movement_direction, PI/2),
+              snake->thickness * -0.5
+            )
+          ),
+          snake->thickness * 0.2, BLACK);
+
+
+    }
+    i--;
+  }
+
+
+  Vector2 head = snakePartLerp(body, body->count - 1, alpha);
+  float triangle_size = 0.8;
+  float triangle_offset = 3;
+  DrawTriangle(
+      Vector2Add(
+        Vector2Add(
+          head,
+          Vector2Scale(snake->movement_direction, snake->thickness * triangle_offset)
+        ),
+        Vector2Rotate(
+          Vector2Scale(snake->movement_direction, snake->thickness * triangle_size),
+          -PI/2
+        )
+      ),
+      Vector2Add(
+        Vector2Add(
+          head,
+          Vector2Scale(snake->movement_direction, snake->thickness * triangle_offset)
+        ),
+        Vector2Rotate(
+          Vector2Scale(snake->movement_direction, snake->thickness * triangle_size),
+          PI/2
+        )
+      ),
+      Vector2Add(
+        head,
+        Vector2Scale(snake->movement_direction, snake->thickness * (triangle_offset + triangle_size))
+      ),
+      (Color){255,255,255,100}
+  );
+}
+
+// World-space rectangle covered by the screen
+Rectangle visibleWorld(Camera2D camera) {
+  Vector2 corners[4] = {
+    GetScreenToWorld2D((Vector2){0, 0}, camera),
+    GetScreenToWorld2D((Vector2){GetScreenWidth(), 0}, camera),
+    GetScreenToWorld2D((Vector2){0, GetScreenHeight()}, camera),
+    GetScreenToWorld2D((Vector2){GetScreenWidth(), GetScreenHeight()}, camera),
+  };
+  Vector2 min = corners[0];
+  Vector2 max = corners[0];
+  for (int c = 1; c < 4; c++) {
+    min = Vector2Min(min, corners[c]);
+    max = Vector2Max(max, corners[c]);
+  }
+  return (Rectangle){min.x, min.y, max.x - min.x, max.y - min.y};
+}
+
+// Rough test for a snake being on screen: its head is within reach of the
+// view, counting every part as stretched to twice PART_LENGTH
+bool snakeVisible(Snake* snake, Rectangle view, float alpha) {
+  Vector2 head = snakePartLerp(&snake->body, snake->body.count - 1, alpha);
+  float reach = snake->body.count * PART_LENGTH * 2 + snake->thickness * 1.2;
+  return head.x + reach >= view.x && head.x - reach <= view.x + view.width &&
+         head.y + reach >= view.y && head.y - reach <= view.y + view.height;
+}
+
+// Colour from the position so it stays put when pellets are reordered
+int pelletColor(Vector2 pos) {
+  return ((int)pos.x ^ (int)pos.y) & 3;
+}
+
+// Pellets in the chunks the view overlaps, in one instanced draw or as
+// triangle fans in circles mode. Must run inside BeginMode2D.
+void renderPellets(BodyRenderer* renderer, const PelletField* field, Rectangle view) {
+  if (field->side == 0) return;
+  int x0 = Clamp(pelletChunkCoord(field, view.x - PELLET_RADIUS), 0, field->side - 1);
+  int x1 = Clamp(pelletChunkCoord(field, view.x + view.width + PELLET_RADIUS), 0, field->side - 1);
+  int y0 = Clamp(pelletChunkCoord(field, view.y - PELLET_RADIUS), 0, field->side - 1);
+  int y1 = Clamp(pelletChunkCoord(field, view.y + view.height + PELLET_RADIUS), 0, field->side - 1);
+
+  for (int cy = y0; cy <= y1; cy++) {
+    for (int cx = x0; cx <= x1; cx++) {
+      const PelletChunk* chunk = &field->chunks[cy * field->side + cx];
+      if (renderer->mode == BODY_RENDER_CIRCLES) {
+        for (int i = 0; i < chunk->count; i++) {
+          Vector2 pos = {chunk->x[i], chunk->y[i]};
+          drawUnitCircle(renderer, pos, PELLET_RADIUS, PELLET_PALETTE[pelletColor(pos)]);
+        }
+        continue;
+      }
+
+      Matrix* transforms = queueInstances(renderer, chunk->count);
+      for (int i = 0; i < chunk->count; i++) {
+        Vector2 pos = {chunk->x[i], chunk->y[i]};
+        transforms[i] = (Matrix){
+          .m0 = PELLET_RADIUS, .m5 = PELLET_RADIUS, .m10 = 1, .m15 = 1,
+          .m12 = pos.x, .m13 = pos.y,
+          .m8 = SNAKE_PALETTE_SIZE + pelletColor(pos),
+        };
+      }
+    }
+  }
+  if (renderer->mode != BODY_RENDER_CIRCLES) flushBodyInstances(renderer);
+}
+
+// Every visible pellet and snake in the world. Must run inside BeginMode2D.
+void renderWorld(BodyRenderer* renderer, World* world, Camera2D camera, float alpha) {
+  Rectangle view = visibleWorld(camera);
+  renderPellets(renderer, &world->pellets, view);
+
+  if (renderer->mode == BODY_RENDER_INSTANCED) {
+    for (int s = 0; s < world->slotCount; s++) {
+      if (!world->alive[s] || !snakeVisible(&world->snakes[s], view, alpha)) continue;
+      queueSnakeBodyInstances(renderer, &world->snakes[s], alpha);
+    }
+    flushBodyInstances(renderer);
+  }
+
+  for (int s = 0; s < world->slotCount; s++) {
+    if (!world->alive[s] || !snakeVisible(&world->snakes[s], view, alpha)) continue;
+    renderSnake(renderer, &world->snakes[s], alpha);
+  }
+}
+
+// The per-part loop moveSnake ran before the body was split into x, y and
+// length arrays, kept as the baseline for --bench-move
+void followLeaderReference(SnakePart* parts, int n, float k) {
+  for (int i = 0; i < n - 1; i++) {
+    Vector2 dpos = Vector2Subtract(parts[i + 1].pos, parts[i].pos);
+    if ( Vector2Length(dpos) > parts[i].length) {
+      parts[i].pos = Vector2Add(parts[i].pos, Vector2Scale(dpos, k));
+    }
+  }
+}
+
+void initBenchSnake(Snake* snake, int partCount) {
+  freeSnakeBody(&snake->body);
+  for (int i = 0; i < partCount; i++) {
+    addSnakeFront(snake, (Vector2){i * 2.0f, 20 * sinf(i * 0.05f)}, 1);
+  }
+}
+
+// Compares the reference loop, the scalar kernel and the SIMD kernel on the
+// same starting body. Times are per part per tick.
+void benchMove() {
+  const int sizes[] = {1000, 10000, 100000};
+  const float dt = 1.0 / 240;
+  const float k = followGain(dt);
+
+  printf("follow-the-leader kernel, %d lanes\n", FOLLOW_LANES);
+  printf(
+      "%10s %14s %14s %14s %8s %6s\n",
+      "parts", "reference ns", "scalar ns", "simd ns", "speedup", "match"
+  );
+
+  for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+    int n = sizes[s];
+    int ticks = 50000000 / n;
+    Snake snake = {0};
+
+    initBenchSnake(&snake, n);
+    SnakePart* parts = malloc(sizeof(SnakePart) * n);
+    for (int i = 0; i < n; i++) parts[i] = snakePart(&snake.body, i);
+    double t0 = nowSeconds();
+    for (int t = 0; t < ticks; t++) {
+      followLeaderReference(parts, n, k);
+      parts[n - 1].pos.x += SPEED * dt;
+    }
+    double reference = nowSeconds() - t0;
+
+    initBenchSnake(&snake, n);
+    SnakeBody* body = &snake.body;
+    t0 = nowSeconds();
+    for (int t = 0; t < ticks; t++) {
+      followLeaderScalar(
+          body->x, body->y, body->length, n - 1,
+          body->x[n - 1], body->y[n - 1], k
+      );
+      body->x[n - 1] += SPEED * dt;
+    }
+    double scalar = nowSeconds() - t0;
+    float* scalarX = malloc(sizeof(float) * n);
+    memcpy(scalarX, body->x, sizeof(float) * n);
+
+    initBenchSnake(&snake, n);
+    t0 = nowSeconds();
+    for (int t = 0; t < ticks; t++) {
+      moveSnakeBody(body, k);
+      body->x[n - 1] += SPEED * dt;
+    }
+    double simd = nowSeconds() - t0;
+    int match = memcmp(scalarX, body->x, sizeof(float) * n) == 0;
+
+    double scale = 1e9 / ((double)n * ticks);
+    printf(
+        "%10d %14.3f %14.3f %14.3f %7.2fx %6s\n",
+        n, reference * scale, scalar * scale, simd * scale,
+        reference / simd, match ? "yes" : "no"
+    );
+
+    free(scalarX);
+    free(parts);
+    freeSnakeBody(body);
+  }
+}
+
+// Grid of dots every GRID_SIZE world units, GRID_DOT wide, matching
+// background.fs
+#define GRID_SIZE 50
+#define GRID_DOT 4
+const Color GRID_COLOR = {51, 51, 77, 255};
+
+typedef enum {
+  BACKGROUND_DOTS,           // One small rectangle per visible grid point
+  BACKGROUND_TEXTURE,        // A single tile repeated over the visible area
+  BACKGROUND_SHADER,         // Full-screen pass through background.fs
+  BACKGROUND_SHADER_INVERSE, // The same in background_inverse.fs, which
+                             // inverts the camera matrix per pixel
+} BackgroundMode;
+
+typedef struct {
+  BackgroundMode mode;
+
+  Shader shader;
+  int mvpLoc;
+  int resolutionLoc;
+  int screenToWorldLoc;
+  int cameraTransformLoc;
+
+  Texture2D tile;
+} Background;
+
+void loadBackground(Background* background, BackgroundMode mode) {
+  *background = (Background){ .mode = mode };
+
+  if (mode == BACKGROUND_SHADER) {
+    background->shader = LoadShader("background.vs", "background.fs");
+    background->mvpLoc = GetShaderLocation(background->shader, "mvp");
+    background->resolutionLoc = GetShaderLocation(background->shader, "screenSize");
+    background->screenToWorldLoc = GetShaderLocation(background->shader, "screenToWorld");
+  }
+  else if (mode == BACKGROUND_SHADER_INVERSE) {
+    background->shader = LoadShader("background.vs", "background_inverse.fs");
+    background->mvpLoc = GetShaderLocation(background->shader, "mvp");
+    background->resolutionLoc = GetShaderLocation(background->shader, "screenSize");
+    background->cameraTransformLoc = GetShaderLocation(background->shader, "cameraTransform");
+  }
+  else if (mode == BACKGROUND_TEXTURE) {
+    Image tile = GenImageColor(GRID_SIZE, GRID_SIZE, BLANK);
+    ImageDrawRectangle(&tile, 0, 0, GRID_DOT, GRID_DOT, GRID_COLOR);
+    background->tile = LoadTextureFromImage(tile);
+    UnloadImage(tile);
+    SetTextureWrap(background->tile, TEXTURE_WRAP_REPEAT);
+  }
+}
+
+void unloadBackground(Background* background) {
+  if (background->mode == BACKGROUND_SHADER || background->mode == BACKGROUND_SHADER_INVERSE) {
+    UnloadShader(background->shader);
+  }
+  if (background->mode == BACKGROUND_TEXTURE) UnloadTexture(background->tile);
+}
+
+// World-space rectangle covered by the screen, snapped out to grid lines
+Rectangle visibleGrid(Camera2D camera) {
+  Rectangle view = visibleWorld(camera);
+  Vector2 min = {
+    floorf(view.x / GRID_SIZE) * GRID_SIZE,
+    floorf(view.y / GRID_SIZE) * GRID_SIZE,
+  };
+  Vector2 max = {
+    ceilf((view.x + view.width) / GRID_SIZE) * GRID_SIZE,
+    ceilf((view.y + view.height) / GRID_SIZE) * GRID_SIZE,
+  };
+  return (Rectangle){min.x, min.y, max.x - min.x, max.y - min.y};
+}
+
+void renderBackground(Background* background, Camera2D camera) {
+  ClearBackground((Color){7,5,13,255});
+
+  if (background->mode == BACKGROUND_SHADER || background->mode == BACKGROUND_SHADER_INVERSE) {
+    Vector2 resolution = { GetScreenWidth(), GetScreenHeight() };
+    SetShaderValue(background->shader, background->resolutionLoc, &resolution, SHADER_UNIFORM_VEC2);
+    Matrix cameraMatrix = GetCameraMatrix2D(camera);
+    SetShaderValueMatrix(background->shader, background->mvpLoc, cameraMatrix);
+    if (background->mode == BACKGROUND_SHADER) {
+      SetShaderValueMatrix(background->shader, background->screenToWorldLoc, MatrixInvert(cameraMatrix));
+    }
+    else {
+      SetShaderValueMatrix(background->shader, background->cameraTransformLoc, cameraMatrix);
+    }
+
+    BeginShaderMode(background->shader);
+    DrawRectangle(0, 0, GetScreenWidth(), GetScreenHeight(), WHITE);
+    EndShaderMode();
+    return;
+  }
+
+  Rectangle grid = visibleGrid(camera);
+  BeginMode2D(camera);
+  if (background->mode == BACKGROUND_TEXTURE) {
+    // Texture coordinates are world units over the tile size, so the
+    // repeat lines the dots up with the grid wherever the rectangle starts
+    DrawTexturePro(background->tile, grid, grid, (Vector2){0, 0}, 0, WHITE);
+  }
+  else {
+    for (float x = grid.x; x <= grid.x + grid.width; x += GRID_SIZE) {
+      for (float y = grid.y; y <= grid.y + grid.height; y += GRID_SIZE) {
+        DrawRectangleV((Vector2){x, y}, (Vector2){GRID_DOT, GRID_DOT}, GRID_COLOR);
+      }
+    }
+  }
+  EndMode2D();
+}
+
+// Size of the baked speedlines noise. The shader samples the noise on a
+// circle of radius 30 lattice cells, so 1024 texels around it keeps a few
+// per cell, and time wraps after NOISE_PERIOD cells.
+#define NOISE_WIDTH 1024
+#define NOISE_HEIGHT 256
+#define NOISE_PERIOD 64
+#define NOISE_RADIUS 30
+
+// The speedlines only show outside RADIUS, so they are drawn as a ring of
+// this many segments instead of a full-screen rectangle
+#define SPEEDLINES_SEGMENTS 64
+
+typedef enum {
+  SPEEDLINES_BAKED,      // Noise read from a texture made at startup
+  SPEEDLINES_PROCEDURAL, // Noise evaluated per pixel in speedlines.fs
+} SpeedlinesMode;
+
+typedef struct {
+  SpeedlinesMode mode;
+  Shader shader;
+  int iResolutionLoc;
+  int iTimeLoc;
+  int radiusLoc;
+  int noiseTextureLoc;
+  Texture2D noise;
+
+  Vector2 ring[2 * (SPEEDLINES_SEGMENTS + 1)];
+
+  // Fragments the ring skipped compared to a full-screen pass. Estimated
+  // from the ring's geometry, nothing is counted on the GPU.
+  int boostFrames;
+  double fragmentsSaved;
+  double fragmentsTotal;
+} Speedlines;
+
+// hash() and smoothNoise() from speedlines.fs, except that the lattice
+// repeats every NOISE_PERIOD cells along z so the baked texture tiles in time
+Vector3 noiseHash(Vector3 p) {
+  p.z = fmodf(p.z, NOISE_PERIOD);
+  Vector3 h = {
+    p.x * 127.1f + p.y * 311.7f + p.z * 74.7f,
+    p.x * 269.5f + p.y * 183.3f + p.z * 246.1f,
+    p.x * 113.5f + p.y * 271.9f + p.z * 173.3f,
+  };
+  h.x = sinf(h.x) * 43758.5453123f;
+  h.y = sinf(h.y) * 43758.5453123f;
+  h.z = sinf(h.z) * 43758.5453123f;
+  return (Vector3){
+    -1 + 2 * (h.x - floorf(h.x)),
+    -1 + 2 * (h.y - floorf(h.y)),
+    -1 + 2 * (h.z - floorf(h.z)),
+  };
+}
+
+float smoothNoise(Vector3 p) {
+  Vector3 i = {floorf(p.x), floorf(p.y), floorf(p.z)};
+  Vector3 f = Vector3Subtract(p, i);
+
+  float corner[8];
+  for (int c = 0; c < 8; c++) {
+    Vector3 offset = {c & 1, (c >> 1) & 1, (c >> 2) & 1};
+    corner[c] = Vector3DotProduct(
+        noiseHash(Vector3Add(i, offset)), Vector3Subtract(f, offset)
+    );
+  }
+
+  return Lerp(
+      Lerp(Lerp(corner[0], corner[1], f.x), Lerp(corner[2], corner[3], f.x), f.y),
+      Lerp(Lerp(corner[4], corner[5], f.x), Lerp(corner[6], corner[7], f.x), f.y),
+      f.z
+  );
+}
+
+Texture2D bakeSpeedlinesNoise() {
+  unsigned char* pixels = malloc(NOISE_WIDTH * NOISE_HEIGHT);
+  for (int y = 0; y < NOISE_HEIGHT; y++) {
+    float z = (y + 0.5f) * NOISE_PERIOD / NOISE_HEIGHT;
+    for (int x = 0; x < NOISE_WIDTH; x++) {
+      float angle = 2 * PI * (x + 0.5f) / NOISE_WIDTH;
+      float noise = smoothNoise(
+          (Vector3){NOISE_RADIUS * cosf(angle), NOISE_RADIUS * sinf(angle), z}
+      );
+      pixels[y * NOISE_WIDTH + x] = Clamp((noise + 1) / 2, 0, 1) * 255;
+    }
+  }
+
+  Image image = {
+    .data = pixels,
+    .width = NOISE_WIDTH,
+    .height = NOISE_HEIGHT,
+    .mipmaps = 1,
+    .format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE,
+  };
+  Texture2D texture = LoadTextureFromImage(image);
+  free(pixels);
+
+  SetTextureWrap(texture, TEXTURE_WRAP_REPEAT);
+  SetTextureFilter(texture, TEXTURE_FILTER_BILINEAR);
+  return texture;
+}
+
+void loadSpeedlines(Speedlines* speedlines, SpeedlinesMode mode) {
+  *speedlines = (Speedlines){ .mode = mode };
+
+  if (mode == SPEEDLINES_BAKED) {
+    speedlines->shader = LoadShader(0, "speedlines_baked.fs");
+    speedlines->noise = bakeSpeedlinesNoise();
+    speedlines->noiseTextureLoc = GetShaderLocation(speedlines->shader, "noiseTexture");
+    float period = NOISE_PERIOD;
+    SetShaderValue(
+        speedlines->shader, GetShaderLocation(speedlines->shader, "noisePeriod"),
+        &period, SHADER_UNIFORM_FLOAT
+    );
+  }
+  else {
+    speedlines->shader = LoadShader(0, "speedlines.fs");
+  }
+
+  // Get uniform locations
+  speedlines->iResolutionLoc = GetShaderLocation(speedlines->shader, "iResolution");
+  speedlines->iTimeLoc = GetShaderLocation(speedlines->shader, "iTime");
+  speedlines->radiusLoc = GetShaderLocation(speedlines->shader, "RADIUS");
+}
+
+void unloadSpeedlines(Speedlines* speedlines) {
+  if (speedlines->boostFrames > 0) {
+    TraceLog(
+        LOG_INFO,
+        "SPEEDLINES: %d boost frames, estimated %.0f of %.0f fragments skipped per frame (%.1f%%, from geometry)",
+        speedlines->boostFrames,
+        speedlines->fragmentsSaved / speedlines->boostFrames,
+        speedlines->fragmentsTotal / speedlines->boostFrames,
+        100 * speedlines->fragmentsSaved / speedlines->fragmentsTotal
+    );
+  }
+  UnloadShader(speedlines->shader);
+  if (speedlines->mode == SPEEDLINES_BAKED) UnloadTexture(speedlines->noise);
+}
+
+// Share of the [-1, 1] square inside a circle of the given radius
+float circleInSquare(float radius) {
+  if (radius <= 1) return PI * radius * radius / 4;
+  if (radius >= M_SQRT2) return 1;
+  return sqrtf(radius * radius - 1) + radius * radius / 2 * (PI / 2 - 2 * acosf(1 / radius));
+}
+
+// Triangle strip between a polygon inscribed in the RADIUS ellipse and one
+// around the screen corners. The shader still discards what is left inside
+// the ellipse between the polygon's edges.
+void drawSpeedlinesRing(Speedlines* speedlines, float radius) {
+  Vector2 center = { GetScreenWidth() / 2.0f, GetScreenHeight() / 2.0f };
+  float outer = M_SQRT2 / cosf(PI / SPEEDLINES_SEGMENTS);
+  for (int s = 0; s <= SPEEDLINES_SEGMENTS; s++) {
+    float angle = 2 * PI * s / SPEEDLINES_SEGMENTS;
+    Vector2 direction = { cosf(angle) * center.x, sinf(angle) * center.y };
+    speedlines->ring[2 * s] = Vector2Add(center, Vector2Scale(direction, outer));
+    speedlines->ring[2 * s + 1] = Vector2Add(center, Vector2Scale(direction, radius));
+  }
+  DrawTriangleStrip(speedlines->ring, 2 * (SPEEDLINES_SEGMENTS + 1), WHITE);
+
+  float polygon = SPEEDLINES_SEGMENTS / (2 * PI) * sinf(2 * PI / SPEEDLINES_SEGMENTS);
+  float screen = GetScreenWidth() * GetScreenHeight();
+  speedlines->boostFrames++;
+  speedlines->fragmentsSaved += screen * circleInSquare(radius) * polygon;
+  speedlines->fragmentsTotal += screen;
+}
+
+// Overlay during boost
+void renderSpeedlines(Speedlines* speedlines, const Snake* snake, float time) {
+  if ((snake->current_speed / SPEED) <= 1.1) return;
+
+  SetShaderValue(
+      speedlines->shader,
+      speedlines->iResolutionLoc,
+      &(Vector2){GetScreenWidth(),GetScreenHeight()},
+      SHADER_UNIFORM_VEC2
+  );
+  SetShaderValue(speedlines->shader, speedlines->iTimeLoc, &time, SHADER_UNIFORM_FLOAT);
+  const float radius_min = 0.65;
+  float radius = 
+    (SPEED * BOOST - snake->current_speed) / (SPEED * BOOST - SPEED) *
+    (M_SQRT2 - radius_min) + radius_min;
+  SetShaderValue(
+      speedlines->shader,
+      speedlines->radiusLoc,
+      &radius,
+      SHADER_UNIFORM_FLOAT
+  );
+  // Nothing on screen is outside the ring yet
+  if (radius >= M_SQRT2) return;
+
+  if (speedlines->mode == SPEEDLINES_BAKED) {
+    SetShaderValueTexture(speedlines->shader, speedlines->noiseTextureLoc, speedlines->noise);
+  }
+  BeginShaderMode(speedlines->shader);
+  drawSpeedlinesRing(speedlines, radius);
+  EndShaderMode();
+}
+
+// Hash of every live part position, to check that runs agree bit for bit
+unsigned long worldChecksum(World* world) {
+  unsigned long hash = 14695981039346656037UL;
+  for (int s = 0; s < world->slotCount; s++) {
+    if (!world->alive[s]) continue;
+    SnakeBody* body = &world->snakes[s].body;
+    for (int p = 0; p < body->count; p++) {
+      int j = snakePartIndex(body, p);
+      unsigned int bits[2];
+      memcpy(&bits[0], &body->x[j], sizeof(float));
+      memcpy(&bits[1], &body->y[j], sizeof(float));
+      hash = (hash ^ bits[0]) * 1099511628211UL;
+      hash = (hash ^ bits[1]) * 1099511628211UL;
+    }
+  }
+  return hash;
+}
+
+// Tick time of moveWorld from one worker up to every core, on an arena of
+// small bots plus one 50k-part snake
+void benchJobs() {
+  const int bots = 2000;
+  const int ticks = 200;
+  const float dt = 1.0 / TICK_RATE;
+  int cores = countCores();
+
+  printf("%8s %12s %9s %8s %18s\n", "workers", "ms/tick", "speedup", "steals", "checksum");
+  double base = 0;
+  for (int workers = 1; ; workers *= 2) {
+    if (workers > cores) workers = cores;
+
+    JobSystem jobs;
+    initJobSystem(&jobs, workers);
+    World world;
+    initWorld(&world, bots + 1, 1);
+    world.jobs = &jobs;
+    spawnSnake(&world, (Vector2){0, 0}, (Vector2){1, 0}, 50000);
+    spawnBots(&world, bots, 50);
+
+    double t0 = nowSeconds();
+    for (int t = 0; t < ticks; t++) {
+      steerBots(&world, dt);
+      moveWorld(&world, dt);
+    }
+    double perTick = (nowSeconds() - t0) / ticks;
+    if (workers == 1) base = perTick;
+
+    printf(
+        "%8d %12.3f %8.2fx %8ld %18lx\n",
+        workers, perTick * 1e3, base / perTick, atomic_load(&jobs.steals),
+        worldChecksum(&world)
+    );
+
+    freeWorld(&world);
+    freeJobSystem(&jobs);
+    if (workers == cores) break;
+  }
+}
+
+// Turns ever longer snakes into pellets. The body is laid on a spiral
+// inside the arena so the drain sees the chunk runs a real death would.
+void benchDeath() {
+  const int sizes[] = {1000, 10000, 100000, 1000000};
+
+  printf(
+      "%10s %10s %8s %14s %14s\n",
+      "parts", "queue ms", "ticks", "worst tick ms", "total ms"
+  );
+  for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+    PelletField field;
+    initPellets(&field, 0);
+    Snake snake;
+    initSnake(&snake, (Vector2){0, 0}, (Vector2){1, 0}, 0);
+    growSnakeBody(&snake.body, sizes[s]);
+    const float spacing = 30 / (2 * PI);
+    for (int i = 0; i < sizes[s]; i++) {
+      float angle = sqrtf(2 * PART_LENGTH * i / spacing);
+      Vector2 pos = {cosf(angle) * spacing * angle, sinf(angle) * spacing * angle};
+      addSnakeFront(&snake, pos, PART_LENGTH);
+    }
+
+    queueSnakePellets(&field, &snake);
+    int ticks = 0;
+    double t0 = nowSeconds();
+    while (field.deadEnd > field.deadStart) {
+      drainDeathPellets(&field);
+      ticks++;
+    }
+    double total = nowSeconds() - t0;
+
+    printf(
+        "%10d %10.3f %8d %14.3f %14.3f\n",
+        sizes[s], field.largestDeathTime * 1e3, ticks,
+        field.slowestDrainTime * 1e3, total * 1e3
+    );
+    freeSnakeBody(&snake.body);
+    freePellets(&field);
+  }
+}
+
+int gamepad = 0;
+
+void selectGamepad() {
+  while (
+    !IsGamepadAvailable(gamepad) && 
+    gamepad > 0
+  ) gamepad--;
+
+  while (
+    IsGamepadAvailable(gamepad) && 
+    TextFindIndex(GetGamepadName(gamepad), "Touchpad") > -1
+  ) gamepad++;
+}
+
+int screen_mainmenu() {
+    selectGamepad();
+
+    if (IsGamepadAvailable(gamepad)){
+      if (IsGamepadButtonPressed(gamepad, GAMEPAD_BUTTON_RIGHT_FACE_DOWN)) return 1;
+    }
+    else {
+      if (IsKeyPressed(KEY_ENTER)) return 1;
+    }
+
+    BeginDrawing();
+    ClearBackground(BLACK);
+
+    if (IsGamepadAvailable(gamepad)){
+      DrawTextEx(
+        GetFontDefault(),
+        "Press A\n"
+        "to start",
+        (Vector2){50,150}, 36, 10, WHITE
+      );
+    }
+    else {
+      DrawTextEx(
+        GetFontDefault(),
+        "Press ENTER\n"
+        "to start",
+        (Vector2){50,150}, 36, 10, WHITE
+      );
+    }
+
+    EndDrawing();
+    return 0;
+}
+
+enum {
+  INPUT_KEY_W = 1 << 0,
+  INPUT_KEY_A = 1 << 1,
+  INPUT_KEY_S = 1 << 2,
+  INPUT_KEY_D = 1 << 3,
+  INPUT_KEY_SPACE = 1 << 4,
+};
+
+// Everything input_gamepad and input_keymouse read, sampled once per frame.
+// The simulation only ever sees this, so it can be fed from something other
+// than a window.
+typedef struct {
+  bool gamepad;                 // Which of the two mappings to apply
+  float axes[6];                // Indexed by GAMEPAD_AXIS_*
+  unsigned int buttons_down;    // One bit per GAMEPAD_BUTTON_*
+  unsigned int buttons_pressed;
+  Vector2 mouse;
+  Vector2 screen;               // Render size, the mouse steers from its center
+  unsigned int keys;            // INPUT_KEY_* bits
+} InputFrame;
+
+bool inputButtonDown(const InputFrame* in, int button) {
+  return in->buttons_down & (1u << button);
+}
+
+bool inputButtonPressed(const InputFrame* in, int button) {
+  return in->buttons_pressed & (1u << button);
+}
+
+void sampleInput(InputFrame* in) {
+  selectGamepad();
+
+  *in = (InputFrame){
+    .gamepad = IsGamepadAvailable(gamepad),
+    .mouse = GetMousePosition(),
+    .screen = {GetRenderWidth(), GetRenderHeight()},
+  };
+
+  if (in->gamepad) {
+    for (int axis = 0; axis < 6; axis++) {
+      in->axes[axis] = GetGamepadAxisMovement(gamepad, axis);
+    }
+    for (int button = 0; button <= GAMEPAD_BUTTON_RIGHT_THUMB; button++) {
+      if (IsGamepadButtonDown(gamepad, button)) in->buttons_down |= 1u << button;
+      if (IsGamepadButtonPressed(gamepad, button)) in->buttons_pressed |= 1u << button;
+    }
+  }
+
+  if (IsKeyDown(KEY_W)) in->keys |= INPUT_KEY_W;
+  if (IsKeyDown(KEY_A)) in->keys |= INPUT_KEY_A;
+  if (IsKeyDown(KEY_S)) in->keys |= INPUT_KEY_S;
+  if (IsKeyDown(KEY_D)) in->keys |= INPUT_KEY_D;
+  if (IsKeyDown(KEY_SPACE)) in->keys |= INPUT_KEY_SPACE;
+}
+
+// Stand-in for a player when there is no window: circles on the left stick,
+// grows every few seconds and boosts in bursts
+void syntheticInput(InputFrame* in, int tick, float dt) {
+  float t = tick * dt;
+  *in = (InputFrame){
+    .gamepad = true,
+    .screen = {WINDOW_WIDTH, WINDOW_HEIGHT},
+  };
+  in->axes[GAMEPAD_AXIS_LEFT_X] = cosf(t * 0.7f);
+  in->axes[GAMEPAD_AXIS_LEFT_Y] = sinf(t * 0.7f);
+  in->axes[GAMEPAD_AXIS_LEFT_TRIGGER] = -1;
+  in->axes[GAMEPAD_AXIS_RIGHT_TRIGGER] = -1;
+
+  int growPeriod = (int)(3 / dt);
+  if (tick % (growPeriod > 1 ? growPeriod : 1) == 0) {
+    in->buttons_pressed |= 1u << GAMEPAD_BUTTON_RIGHT_FACE_DOWN;
+  }
+  if (fmodf(t, 5) < 1) {
+    in->buttons_down |= 1u << GAMEPAD_BUTTON_RIGHT_FACE_RIGHT;
+  }
+}
+
+void input_gamepad(Camera2D* camera, Snake* snake, const InputFrame* in, float dt){
+  float targetZoom = 
+    1.0 +
+    (in->axes[GAMEPAD_AXIS_LEFT_TRIGGER] + 1) / 2 *
+    ZOOM_MAX;
+  camera->zoom = Lerp(camera->zoom, targetZoom, dt / 0.2);
+
+
+  Vector2 temp_direction = (Vector2){
+    in->axes[GAMEPAD_AXIS_LEFT_X],
+    in->axes[GAMEPAD_AXIS_LEFT_Y]
+  };
+
+  snake->look_direction = (Vector2){
+    in->axes[GAMEPAD_AXIS_RIGHT_X],
+    in->axes[GAMEPAD_AXIS_RIGHT_Y]
+  };
+
+  if (Vector2Length(temp_direction) > DEADZONE) {
+   snake->movement_direction = Vector2Normalize(
+      Vector2Lerp(
+        snake->movement_direction,
+        temp_direction,
+        dt / 0.05
+      )
+    );
+  }
+
+  if (inputButtonPressed(in, GAMEPAD_BUTTON_RIGHT_FACE_DOWN)) {
+    SnakePart tail = snakeTail(snake);
+    addSnakeTailN(snake, tail.pos, tail.length, 10);
+  }
+
+  
+  if ( inputButtonDown(in, GAMEPAD_BUTTON_RIGHT_FACE_RIGHT) &&
+       (snake->body.count > 10) ) {
+    //printf("boost %f && %d\n", snake->boost_time, snake->body.count);
+    if ( (snake->boost_time <= 0) && (snake->body.count > 10) ) {
+      snake->boost_time += 0.2;
+      popSnakeTail(snake);
+    }
+  }
+  
+
+  //real_direction = input_direction;
+  
+}
+
+void input_keymouse(Camera2D* camera, Snake* snake, const InputFrame* in, float dt) {
+      float targetZoom = (in->keys & INPUT_KEY_SPACE) ? ZOOM_MAX : 1.0;
+      camera->zoom = Lerp(camera->zoom, targetZoom, dt / 0.2);
+
+      Vector2 temp_direction = Vector2Normalize(
+        Vector2Subtract(
+          in->mouse,
+          Vector2Scale(in->screen, 0.5)
+        )
+      );
+
+      if (Vector2Length(temp_direction) > DEADZONE) {
+        snake->movement_direction = Vector2Normalize(
+          Vector2Lerp(
+            snake->movement_direction,
+            temp_direction,
+            dt * 20
+          )
+        );
+      }
+
+      snake->look_direction = (Vector2){0, 0};
+      if (in->keys & INPUT_KEY_W) snake->look_direction = Vector2Add(
+          snake->look_direction, (Vector2){0, -1}
+        );
+      if (in->keys & INPUT_KEY_A) snake->look_direction = Vector2Add(
+          snake->look_direction, (Vector2){-1, 0}
+        );
+      if (in->keys & INPUT_KEY_S) snake->look_direction = Vector2Add(
+          snake->look_direction, (Vector2){0, 1}
+        );
+      if (in->keys & INPUT_KEY_D) snake->look_direction = Vector2Add(
+          snake->look_direction, (Vector2){1, 0}
+        );
+
+      if (Vector2Length(snake->look_direction) > DEADZONE)
+        snake->look_direction = Vector2Normalize(snake->look_direction);
+}
+
+void applyInput(Camera2D* camera, Snake* snake, const InputFrame* in, float dt) {
+  if (in->gamepad) {
+    input_gamepad(camera, snake, in, dt);
+  }
+  else {
+    input_keymouse(camera, snake, in, dt);
+  }
+}
+
+void updateCamera(Camera2D* camera, const Snake* snake, Vector2 screen, float dt) {
+  Vector2 sdiv2 = Vector2Scale(screen, 0.5);
+  camera->target = Vector2Lerp(
+      camera->target,
+      Vector2Add(
+        Vector2Subtract(
+          snakeHead(snake).pos,
+          sdiv2
+        ),
+        Vector2Scale(
+          snake->look_direction,
+          200 / camera->zoom
+        )
+      ),
+      dt / 0.1
+  );
+  camera->offset = Vector2Scale(sdiv2, 1 - camera->zoom);
+}
+
+Camera2D lerpCamera(Camera2D from, Camera2D to, float alpha) {
+  return (Camera2D){
+    .offset = Vector2Lerp(from.offset, to.offset, alpha),
+    .target = Vector2Lerp(from.target, to.target, alpha),
+    .rotation = Lerp(from.rotation, to.rotation, alpha),
+    .zoom = Lerp(from.zoom, to.zoom, alpha),
+  };
+}
+
+// Spawns a snake steered by input, facing right with its body trailing
+// down from tail
+SnakeHandle spawnHuman(World* world, Vector2 tail) {
+  SnakeHandle handle = spawnSnake(world, tail, (Vector2){0, 1}, 50);
+  world->snakes[handle.slot].movement_direction = (Vector2){1, 0};
+  world->human[handle.slot] = true;
+  return handle;
+}
+
+// Random point in the arena for a human to start over at
+Vector2 respawnPoint(World* world) {
+  float angle = worldRandom(world) * 2 * PI;
+  float distance = sqrtf(worldRandom(world)) * ARENA_RADIUS;
+  return (Vector2){cosf(angle) * distance, sinf(angle) * distance};
+}
+
+// Replaces dead bots so world->bots stay alive
+void refillBots(World* world) {
+  int bots = 0;
+  for (int s = 0; s < world->slotCount; s++) {
+    if (world->alive[s] && !world->human[s]) bots++;
+  }
+  spawnBots(world, world->bots - bots, 50);
+}
+
+// Everything in a tick after the humans' input has been applied
+void stepWorld(World* world, float dt) {
+  PROFILE_SCOPE(PHASE_BOTS) steerBots(world, dt);
+  PROFILE_SCOPE(PHASE_MOVE) moveWorld(world, dt);
+  PROFILE_SCOPE(PHASE_COLLIDE) collideWorld(world);
+  PROFILE_SCOPE(PHASE_FEED) feedWorld(world);
+}
+
+// One fixed step of the whole simulation
+void tickGame(Camera2D* camera, World* world, const InputFrame* in, float dt) {
+  Snake* player = worldPlayer(world);
+  PROFILE_SCOPE(PHASE_INPUT) if (player != NULL) applyInput(camera, player, in, dt);
+  stepWorld(world, dt);
+
+  // A dead player starts over somewhere random
+  if (world->player < 0) world->player = spawnHuman(world, respawnPoint(world)).slot;
+  refillBots(world);
+
+  player = worldPlayer(world);
+  PROFILE_SCOPE(PHASE_CAMERA) updateCamera(camera, player, in->screen, dt);
+}
+
+void initGame(World* world, int bots, int pellets) {
+  initWorld(world, bots + 1, 1);
+  world->bots = bots;
+  world->player = spawnHuman(world, (Vector2){250, 100}).slot;
+  spawnBots(world, bots, 50);
+  initPellets(&world->pellets, pellets);
+  spawnPellets(world, &world->pellets, pellets);
+}
+
+// Regression numbers for one snake's tick: input to direction, body and
+// head movement, and growing and boosting through the tail add/pop paths.
+// The snake grows 10 parts every 10 ticks and is trimmed back to its
+// starting length, so it stays the scenario's size. Prints one CSV row per
+// scenario.
+void benchSim() {
+  const int sizes[] = {50, 1000, 10000, 100000, 1000000};
+  const float dt = 1.0 / TICK_RATE;
+
+  printf("parts,boost,motion,ticks,ns_per_part_tick,allocations_per_tick\n");
+  for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+    for (int boost = 0; boost <= 1; boost++) {
+      for (int turning = 0; turning <= 1; turning++) {
+        // Around 2e7 part updates per scenario
+        int ticks = Clamp(20000000 / sizes[s], 20, 20000);
+        Camera2D camera = { .zoom = 1.0 };
+        Snake snake;
+        initSnake(&snake, (Vector2){0, 0}, (Vector2){1, 0}, sizes[s]);
+
+        long allocations = snakeBodyStats.allocations;
+        long partTicks = 0;
+        double t0 = nowSeconds();
+        for (int tick = 0; tick < ticks; tick++) {
+          float t = tick * dt;
+          InputFrame in = { .gamepad = true, .screen = {WINDOW_WIDTH, WINDOW_HEIGHT} };
+          in.axes[GAMEPAD_AXIS_LEFT_X] = turning ? cosf(t * 2) : 1;
+          in.axes[GAMEPAD_AXIS_LEFT_Y] = turning ? sinf(t * 2) : 0;
+          in.axes[GAMEPAD_AXIS_LEFT_TRIGGER] = -1;
+          if (tick % 10 == 0) in.buttons_pressed |= 1u << GAMEPAD_BUTTON_RIGHT_FACE_DOWN;
+          if (boost) in.buttons_down |= 1u << GAMEPAD_BUTTON_RIGHT_FACE_RIGHT;
+
+          applyInput(&camera, &snake, &in, dt);
+          while (snake.body.count > sizes[s]) popSnakeTail(&snake);
+          moveSnake(&snake, dt);
+          partTicks += snake.body.count;
+        }
+        double elapsed = nowSeconds() - t0;
+
+        printf(
+            "%d,%d,%s,%d,%.3f,%.4f\n",
+            sizes[s], boost, turning ? "turning" : "straight", ticks,
+            elapsed * 1e9 / partTicks,
+            (double)(snakeBodyStats.allocations - allocations) / ticks
+        );
+        freeSnakeBody(&snake.body);
+      }
+    }
+  }
+}
+
+// Blocks until the GPU has run everything submitted so far by reading
+// back a pixel drawn after it
+void waitForGpu(RenderTexture2D fence) {
+  BeginTextureMode(fence);
+  DrawPixel(0, 0, WHITE);
+  EndTextureMode();
+  Image pixel = LoadImageFromTexture(fence.texture);
+  UnloadImage(pixel);
+}
+
+// Draws a fixed run of frames into an offscreen target for every body
+// renderer, background and snake size, and prints the average time of each
+// pass as CSV. Each pass ends with waitForGpu, so the times include the
+// GPU work (and one readback). Any GL 3.3 context works, e.g. Mesa's
+// llvmpipe with LIBGL_ALWAYS_SOFTWARE=1 on machines without a GPU.
+void benchRender(int width, int height) {
+  const int sizes[] = {100, 1000, 10000};
+  const char* bodyNames[] = {"instanced", "circles", "tube"};
+  const char* backgroundNames[] = {"dots", "texture", "shader", "shader-inverse"};
+  const int frames = 120;
+  const float dt = 1.0 / TICK_RATE;
+
+  SetConfigFlags(FLAG_WINDOW_HIDDEN);
+  InitWindow(width, height, "Snake render benchmark");
+  RenderTexture2D target = LoadRenderTexture(width, height);
+  RenderTexture2D fence = LoadRenderTexture(1, 1);
+  Speedlines speedlines;
+  loadSpeedlines(&speedlines, SPEEDLINES_BAKED);
+
+  printf("body,background,parts,frames,background_ms,world_ms,speedlines_ms\n");
+  for (int b = BODY_RENDER_INSTANCED; b <= BODY_RENDER_TUBE; b++) {
+    BodyRenderer renderer;
+    loadBodyRenderer(&renderer, b);
+    for (int g = BACKGROUND_DOTS; g <= BACKGROUND_SHADER_INVERSE; g++) {
+      Background background;
+      loadBackground(&background, g);
+      for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        World world;
+        initGame(&world, 0, 0);
+        // Lay the body out at full length from the player's tail, like a
+        // spawned snake, so every part is drawn somewhere different
+        Snake* player = worldPlayer(&world);
+        Vector2 tail = snakeTail(player).pos;
+        freeSnakeBody(&player->body);
+        initSnake(player, tail, (Vector2){0, 1}, sizes[s]);
+        Camera2D camera = { .zoom = 1.0 };
+
+        // The camera path is the player's, and the player always plays the
+        // same synthetic input
+        double passes[3] = {0};
+        for (int f = 0; f < frames; f++) {
+          InputFrame in;
+          syntheticInput(&in, f, dt);
+          in.screen = (Vector2){width, height};
+          tickGame(&camera, &world, &in, dt);
+          // Keep the speedlines ring on screen
+          player = worldPlayer(&world);
+          player->current_speed = SPEED * BOOST * 0.8;
+
+          double t0 = nowSeconds();
+          BeginTextureMode(target);
+          renderBackground(&background, camera);
+          EndTextureMode();
+          waitForGpu(fence);
+          double t1 = nowSeconds();
+          BeginTextureMode(target);
+          BeginMode2D(camera);
+          renderWorld(&renderer, &world, camera, 1);
+          EndMode2D();
+          EndTextureMode();
+          waitForGpu(fence);
+          double t2 = nowSeconds();
+          BeginTextureMode(target);
+          renderSpeedlines(&speedlines, player, f * dt);
+          EndTextureMode();
+          waitForGpu(fence);
+          double t3 = nowSeconds();
+
+          passes[0] += t1 - t0;
+          passes[1] += t2 - t1;
+          passes[2] += t3 - t2;
+        }
+
+        printf(
+            "%s,%s,%d,%d,%.3f,%.3f,%.3f\n",
+            bodyNames[renderer.mode], backgroundNames[g], sizes[s], frames,
+            passes[0] * 1e3 / frames, passes[1] * 1e3 / frames, passes[2] * 1e3 / frames
+        );
+        freeWorld(&world);
+      }
+      unloadBackground(&background);
+    }
+    unloadBodyRenderer(&renderer);
+  }
+
+  unloadSpeedlines(&speedlines);
+  UnloadRenderTexture(fence);
+  UnloadRenderTexture(target);
+  CloseWindow();
+}
+
+// Input recordings. A replay holds the game's settings and the InputFrame
+// of every tick, and playing it back from the same settings reproduces the
+// run bit for bit: ticks are fixed, the world's random numbers come from
+// its seed, and moveWorld gives the same result on any number of workers.
+// Recording and playback must use the same build, since compiler flags
+// like -ffp-contract and the libm sinf/cosf can change float results.
+//
+// Layout: "SNKR", version byte, then bots, pellets, dt bits and tick count
+// as little-endian u32 and the final state checksum as u64. Tick count and
+// checksum are filled in on close. Every tick is then a flags byte and the
+// fields it names. Floats are stored as the XOR of their bits with the
+// previous tick's, and integers as varints, so ticks where nothing moved
+// are one byte.
+#define REPLAY_VERSION 1
+#define REPLAY_HEADER_SIZE 29
+#define REPLAY_CHECKSUM_TICKS 60  // Ticks between checksums in the stream
+
+enum {
+  REPLAY_GAMEPAD = 1,
+  REPLAY_AXES = 2,       // Mask byte of changed axes, then one varint per axis
+  REPLAY_DOWN = 4,
+  REPLAY_PRESSED = 8,
+  REPLAY_MOUSE = 16,
+  REPLAY_SCREEN = 32,
+  REPLAY_KEYS = 64,
+  REPLAY_CHECKSUM = 128, // State checksum before this tick
+};
+
+typedef struct {
+  FILE* file;
+  bool writing;
+  InputFrame previous;
+  int tick;
+  // Header
+  int bots;
+  int pellets;
+  float dt;
+  int ticks;
+  unsigned long checksum;
+  // Playback
+  int mismatches;
+  int firstMismatch;
+} Replay;
+
+// World checksum plus the random state, which pellets and bots draw from
+unsigned long replayChecksum(World* world) {
+  unsigned long hash = worldChecksum(world);
+  hash = (hash ^ world->seed) * 1099511628211UL;
+  return (hash ^ world->pellets.count) * 1099511628211UL;
+}
+
+void writeVarint(FILE* file, unsigned long value) {
+  while (value >= 0x80) {
+    fputc((value & 0x7f) | 0x80, file);
+    value >>= 7;
+  }
+  fputc(value, file);
+}
+
+bool readVarint(FILE* file, unsigned long* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int byte = fgetc(file);
+    if (byte == EOF) return false;
+    *value |= (unsigned long)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+void writeLittleEndian(FILE* file, unsigned long value, int bytes) {
+  for (int b = 0; b < bytes; b++) fputc((value >> (8 * b)) & 0xff, file);
+}
+
+bool readLittleEndian(FILE* file, unsigned long* value, int bytes) {
+  *value = 0;
+  for (int b = 0; b < bytes; b++) {
+    int byte = fgetc(file);
+    if (byte == EOF) return false;
+    *value |= (unsigned long)byte << (8 * b);
+  }
+  return true;
+}
+
+unsigned int floatBits(float v) {
+  unsigned int bits;
+  memcpy(&bits, &v, sizeof(bits));
+  return bits;
+}
+
+float bitsFloat(unsigned int bits) {
+  float v;
+  memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+
+void writeReplayHeader(Replay* replay) {
+  fwrite("SNKR", 1, 4, replay->file);
+  fputc(REPLAY_VERSION, replay->file);
+  writeLittleEndian(replay->file, replay->bots, 4);
+  writeLittleEndian(replay->file, replay->pellets, 4);
+  writeLittleEndian(replay->file, floatBits(replay->dt), 4);
+  writeLittleEndian(replay->file, replay->ticks, 4);
+  writeLittleEndian(replay->file, replay->checksum, 8);
+}
+
+bool startRecording(Replay* replay, const char* path, int bots, int pellets, float dt) {
+  *replay = (Replay){ .writing = true, .bots = bots, .pellets = pellets, .dt = dt };
+  replay->file = fopen(path, "wb");
+  if (replay->file == NULL) {
+    fprintf(stderr, "could not write replay %s\n", path);
+    return false;
+  }
+  writeReplayHeader(replay);
+  return true;
+}
+
+// Appends the input of the next tick. world is the state it will be
+// applied to.
+void recordTick(Replay* replay, const InputFrame* in, World* world) {
+  const InputFrame* last = &replay->previous;
+  FILE* file = replay->file;
+
+  int axes = 0;
+  for (int a = 0; a < 6; a++) {
+    if (floatBits(in->axes[a]) != floatBits(last->axes[a])) axes |= 1 << a;
+  }
+  bool mouse = floatBits(in->mouse.x) != floatBits(last->mouse.x) ||
+               floatBits(in->mouse.y) != floatBits(last->mouse.y);
+  bool screen = floatBits(in->screen.x) != floatBits(last->screen.x) ||
+                floatBits(in->screen.y) != floatBits(last->screen.y);
+  bool checksum = replay->tick % REPLAY_CHECKSUM_TICKS == 0;
+
+  int flags = (in->gamepad ? REPLAY_GAMEPAD : 0) |
+              (axes ? REPLAY_AXES : 0) |
+              (in->buttons_down != last->buttons_down ? REPLAY_DOWN : 0) |
+              (in->buttons_pressed ? REPLAY_PRESSED : 0) |
+              (mouse ? REPLAY_MOUSE : 0) |
+              (screen ? REPLAY_SCREEN : 0) |
+              (in->keys != last->keys ? REPLAY_KEYS : 0) |
+              (checksum ? REPLAY_CHECKSUM : 0);
+  fputc(flags, file);
+  if (axes) {
+    fputc(axes, file);
+    for (int a = 0; a < 6; a++) {
+      if (axes & (1 << a)) writeVarint(file, floatBits(in->axes[a]) ^ floatBits(last->axes[a]));
+    }
+  }
+  if (flags & REPLAY_DOWN) writeVarint(file, in->buttons_down ^ last->buttons_down);
+  if (flags & REPLAY_PRESSED) writeVarint(file, in->buttons_pressed);
+  if (mouse) {
+    writeVarint(file, floatBits(in->mouse.x) ^ floatBits(last->mouse.x));
+    writeVarint(file, floatBits(in->mouse.y) ^ floatBits(last->mouse.y));
+  }
+  if (screen) {
+    writeVarint(file, floatBits(in->screen.x) ^ floatBits(last->screen.x));
+    writeVarint(file, floatBits(in->screen.y) ^ floatBits(last->screen.y));
+  }
+  if (flags & REPLAY_KEYS) writeVarint(file, in->keys);
+  if (checksum) writeVarint(file, replayChecksum(world));
+
+  replay->previous = *in;
+  replay->tick++;
+}
+
+// Fills in the tick count and the checksum of the final state
+void stopRecording(Replay* replay, World* world) {
+  replay->ticks = replay->tick;
+  replay->checksum = replayChecksum(world);
+  long size = ftell(replay->file);
+  fseek(replay->file, 0, SEEK_SET);
+  writeReplayHeader(replay);
+  fclose(replay->file);
+  TraceLog(
+      LOG_INFO, "REPLAY: recorded %d ticks in %ld bytes (%.2f bytes/tick)",
+      replay->ticks, size, (double)(size - REPLAY_HEADER_SIZE) / (replay->ticks ? replay->ticks : 1)
+  );
+}
+
+bool openReplay(Replay* replay, const char* path) {
+  *replay = (Replay){ .firstMismatch = -1 };
+  replay->file = fopen(path, "rb");
+  if (replay->file == NULL) {
+    fprintf(stderr, "could not read replay %s\n", path);
+    return false;
+  }
+
+  char magic[4];
+  unsigned long bots, pellets, dt, ticks;
+  if (fread(magic, 1, 4, replay->file) != 4 || memcmp(magic, "SNKR", 4) != 0 ||
+      fgetc(replay->file) != REPLAY_VERSION ||
+      !readLittleEndian(replay->file, &bots, 4) ||
+      !readLittleEndian(replay->file, &pellets, 4) ||
+      !readLittleEndian(replay->file, &dt, 4) ||
+      !readLittleEndian(replay->file, &ticks, 4) ||
+      !readLittleEndian(replay->file, &replay->checksum, 8)) {
+    fprintf(stderr, "not a replay: %s\n", path);
+    fclose(replay->file);
+    return false;
+  }
+  replay->bots = bots;
+  replay->pellets = pellets;
+  replay->dt = bitsFloat(dt);
+  replay->ticks = ticks;
+  return true;
+}
+
+// Reads the input of the next tick and checks world against the recorded
+// checksum when there is one. Returns false at the end of the replay.
+bool playTick(Replay* replay, InputFrame* in, World* world) {
+  if (replay->tick == replay->ticks) return false;
+  FILE* file = replay->file;
+  int flags = fgetc(file);
+  if (flags == EOF) return false;
+
+  *in = replay->previous;
+  in->gamepad = flags & REPLAY_GAMEPAD;
+  in->buttons_pressed = 0;
+  unsigned long v = 0;
+  bool ok = true;
+  if (flags & REPLAY_AXES) {
+    int axes = fgetc(file);
+    for (int a = 0; a < 6; a++) {
+      if (!(axes & (1 << a))) continue;
+      ok = ok && readVarint(file, &v);
+      in->axes[a] = bitsFloat(floatBits(in->axes[a]) ^ v);
+    }
+  }
+  if (flags & REPLAY_DOWN) {
+    ok = ok && readVarint(file, &v);
+    in->buttons_down ^= v;
+  }
+  if (flags & REPLAY_PRESSED) {
+    ok = ok && readVarint(file, &v);
+    in->buttons_pressed = v;
+  }
+  if (flags & REPLAY_MOUSE) {
+    ok = ok && readVarint(file, &v);
+    in->mouse.x = bitsFloat(floatBits(in->mouse.x) ^ v);
+    ok = ok && readVarint(file, &v);
+    in->mouse.y = bitsFloat(floatBits(in->mouse.y) ^ v);
+  }
+  if (flags & REPLAY_SCREEN) {
+    ok = ok && readVarint(file, &v);
+    in->screen.x = bitsFloat(floatBits(in->screen.x) ^ v);
+    ok = ok && readVarint(file, &v);
+    in->screen.y = bitsFloat(floatBits(in->screen.y) ^ v);
+  }
+  if (flags & REPLAY_KEYS) {
+    ok = ok && readVarint(file, &v);
+    in->keys = v;
+  }
+  if (flags & REPLAY_CHECKSUM) {
+    ok = ok && readVarint(file, &v);
+    if (ok && v != replayChecksum(world)) {
+      if (replay->mismatches++ == 0) replay->firstMismatch = replay->tick;
+    }
+  }
+  if (!ok) return false;
+
+  replay->previous = *in;
+  replay->tick++;
+  return true;
+}
+
+// Checks the final state and reports whether the whole replay matched
+bool closeReplay(Replay* replay, World* world) {
+  bool complete = replay->tick == replay->ticks;
+  if (complete && replayChecksum(world) != replay->checksum) {
+    if (replay->mismatches++ == 0) replay->firstMismatch = replay->tick;
+  }
+  fclose(replay->file);
+
+  if (!complete) {
+    TraceLog(LOG_WARNING, "REPLAY: stream ended after %d of %d ticks", replay->tick, replay->ticks);
+  }
+  else if (replay->mismatches > 0) {
+    TraceLog(
+        LOG_WARNING, "REPLAY: diverged at tick %d, %d checksums differ",
+        replay->firstMismatch, replay->mismatches
+    );
+  }
+  else {
+    TraceLog(LOG_INFO, "REPLAY: %d ticks reproduced exactly", replay->ticks);
+  }
+  return complete && replay->mismatches == 0;
+}
+
+// Sessions: recordings for long games that can be entered at any tick.
+// The file is a run of chunks, each a full world snapshot (keyframe)
+// followed by the replay encoding of the next keyframeInterval ticks,
+// started afresh so a chunk decodes on its own. A seek table at the end
+// holds one entry per chunk. Readers mmap the file and go straight to
+// a chunk through the table, so reaching tick t costs loading one
+// snapshot and simulating t % keyframeInterval ticks. Structures are
+// stored in host byte order and every chunk starts 8-byte aligned.
+#define SESSION_VERSION 2
+#define SESSION_KEYFRAME_TICKS 1800
+
+typedef struct {
+  char magic[4];            // "SNKS"
+  uint32_t version;
+  uint32_t keyframeInterval;
+  uint32_t ticks;
+  float dt;
+  uint32_t keyframes;
+  uint64_t seekTable;       // Offset of keyframes SessionKeyframe entries
+  uint64_t checksum;        // replayChecksum after the last tick
+} SessionHeader;
+
+typedef struct {
+  uint32_t tick;
+  uint32_t inputBytes;
+  uint64_t snapshot;        // Offset of the world snapshot
+  uint64_t input;           // Offset of the encoded ticks that follow it
+} SessionKeyframe;
+
+// Fixed part of a world snapshot. After it: generation, alive, human and
+// turn per slot, the free list, then per live snake a SnapshotSnake and its
+// x, y, length, prev_x and prev_y arrays tail first, then per pellet
+// chunk its count, x and y, then the death queue's x and y.
+typedef struct {
+  int32_t slotCount;
+  int32_t freeCount;
+  int32_t player;
+  uint32_t seed;
+  int32_t bots;
+  int32_t pelletTarget;
+  int64_t deaths;
+  int64_t eaten;
+  int32_t pelletSide;
+  int32_t deadCount;
+  Camera2D camera;
+} SnapshotWorld;
+
+typedef struct {
+  int32_t count;
+  float thickness;
+  Vector2 movement_direction;
+  Vector2 look_direction;
+  float boost_time;
+  float current_speed;
+} SnapshotSnake;
+
+void writeSnapshotArray(FILE* file, const void* data, size_t size) {
+  if (size > 0) fwrite(data, 1, size, file);
+}
+
+void writeWorldSnapshot(FILE* file, World* world, Camera2D camera) {
+  PelletField* field = &world->pellets;
+  SnapshotWorld header = {
+    .slotCount = world->slotCount,
+    .freeCount = world->freeCount,
+    .player = world->player,
+    .seed = world->seed,
+    .bots = world->bots,
+    .pelletTarget = field->target,
+    .deaths = world->deaths,
+    .eaten = field->eaten,
+    .pelletSide = field->side,
+    .deadCount = field->deadEnd - field->deadStart,
+    .camera = camera,
+  };
+  fwrite(&header, sizeof(header), 1, file);
+  writeSnapshotArray(file, world->generation, sizeof(unsigned int) * world->slotCount);
+  writeSnapshotArray(file, world->alive, sizeof(bool) * world->slotCount);
+  writeSnapshotArray(file, world->human, sizeof(bool) * world->slotCount);
+  writeSnapshotArray(file, world->turn, sizeof(float) * world->slotCount);
+  writeSnapshotArray(file, world->freeSlots, sizeof(int) * world->freeCount);
+
+  float* unwrapped = NULL;
+  int unwrappedCapacity = 0;
+  for (int s = 0; s < world->slotCount; s++) {
+    if (!world->alive[s]) continue;
+    Snake* snake = &world->snakes[s];
+    SnapshotSnake record = {
+      .count = snake->body.count,
+      .thickness = snake->thickness,
+      .movement_direction = snake->movement_direction,
+      .look_direction = snake->look_direction,
+      .boost_time = snake->boost_time,
+      .current_speed = snake->current_speed,
+    };
+    fwrite(&record, sizeof(record), 1, file);
+
+    if (unwrappedCapacity < snake->body.count) {
+      unwrappedCapacity = snake->body.count;
+      unwrapped = realloc(unwrapped, sizeof(float) * unwrappedCapacity);
+    }
+    float** arrays[SNAKE_BODY_ARRAYS];
+    snakeBodyArrays(&snake->body, arrays);
+    for (int a = 0; a < SNAKE_BODY_ARRAYS; a++) {
+      unwrapSnakeArray(&snake->body, unwrapped, *arrays[a]);
+      writeSnapshotArray(file, unwrapped, sizeof(float) * snake->body.count);
+    }
+  }
+  free(unwrapped);
+
+  for (int c = 0; c < field->side * field->side; c++) {
+    PelletChunk* chunk = &field->chunks[c];
+    int32_t count = chunk->count;
+    fwrite(&count, sizeof(count), 1, file);
+    writeSnapshotArray(file, chunk->x, sizeof(float) * count);
+    writeSnapshotArray(file, chunk->y, sizeof(float) * count);
+  }
+  writeSnapshotArray(file, field->deadX + field->deadStart, sizeof(float) * header.deadCount);
+  writeSnapshotArray(file, field->deadY + field->deadStart, sizeof(float) * header.deadCount);
+}
+
+// Bounds-checked reads out of a mapped snapshot
+typedef struct {
+  const unsigned char* at;
+  const unsigned char* end;
+} SnapshotReader;
+
+bool readSnapshot(SnapshotReader* reader, void* dst, size_t size) {
+  if ((size_t)(reader->end - reader->at) < size) return false;
+  if (size > 0) memcpy(dst, reader->at, size);
+  reader->at += size;
+  return true;
+}
+
+// Whether count records of size bytes each can still be in the snapshot,
+// checked before anything is allocated for them
+bool snapshotHas(const SnapshotReader* reader, long count, size_t size) {
+  return count >= 0 && (size_t)count <= (size_t)(reader->end - reader->at) / size;
+}
+
+// Replaces world with the snapshot. Returns false if it is cut short, and
+// the world is then unusable until the next load.
+bool loadWorldSnapshot(World* world, Camera2D* camera, SnapshotReader* reader) {
+  SnapshotWorld header;
+  if (!readSnapshot(reader, &header, sizeof(header))) return false;
+  size_t slotBytes = sizeof(unsigned int) + 2 * sizeof(bool) + sizeof(float);
+  if (!snapshotHas(reader, header.slotCount, slotBytes) ||
+      header.freeCount < 0 || header.freeCount > header.slotCount ||
+      header.player < -1 || header.player >= header.slotCount ||
+      !snapshotHas(reader, header.deadCount, 2 * sizeof(float))) {
+    return false;
+  }
+
+  JobSystem* jobs = world->jobs;
+  freeWorld(world);
+  initWorld(world, header.slotCount > 0 ? header.slotCount : 1, header.seed);
+  world->jobs = jobs;
+  world->slotCount = header.slotCount;
+  world->freeCount = header.freeCount;
+  world->player = header.player;
+  world->bots = header.bots;
+  world->deaths = header.deaths;
+  *camera = header.camera;
+  bool ok = readSnapshot(reader, world->generation, sizeof(unsigned int) * header.slotCount) &&
+            readSnapshot(reader, world->alive, sizeof(bool) * header.slotCount) &&
+            readSnapshot(reader, world->human, sizeof(bool) * header.slotCount) &&
+            readSnapshot(reader, world->turn, sizeof(float) * header.slotCount) &&
+            readSnapshot(reader, world->freeSlots, sizeof(int) * header.freeCount);
+  for (int f = 0; ok && f < world->freeCount; f++) {
+    ok = world->freeSlots[f] >= 0 && world->freeSlots[f] < world->slotCount;
+  }
+  ok = ok && (world->player < 0 || world->alive[world->player]);
+
+  for (int s = 0; ok && s < world->slotCount; s++) {
+    if (!world->alive[s]) continue;
+    SnapshotSnake record;
+    ok = readSnapshot(reader, &record, sizeof(record)) &&
+         snapshotHas(reader, record.count, sizeof(float) * SNAKE_BODY_ARRAYS);
+    if (!ok) break;
+
+    Snake* snake = &world->snakes[s];
+    initSnake(snake, (Vector2){0, 0}, (Vector2){1, 0}, 0);
+    snake->thickness = record.thickness;
+    snake->movement_direction = record.movement_direction;
+    snake->look_direction = record.look_direction;
+    snake->boost_time = record.boost_time;
+    snake->current_speed = record.current_speed;
+    growSnakeBody(&snake->body, record.count);
+    snake->body.count = record.count;
+    countSnakeParts(record.count);
+    world->aliveCount++;
+
+    float** arrays[SNAKE_BODY_ARRAYS];
+    snakeBodyArrays(&snake->body, arrays);
+    for (int a = 0; ok && a < SNAKE_BODY_ARRAYS; a++) {
+      ok = readSnapshot(reader, *arrays[a], sizeof(float) * record.count);
+    }
+  }
+
+  PelletField* field = &world->pellets;
+  initPellets(field, header.pelletTarget);
+  field->eaten = header.eaten;
+  ok = ok && header.pelletSide == field->side;
+  for (int c = 0; ok && c < field->side * field->side; c++) {
+    PelletChunk* chunk = &field->chunks[c];
+    int32_t count;
+    ok = readSnapshot(reader, &count, sizeof(count)) &&
+         snapshotHas(reader, count, 2 * sizeof(float));
+    if (!ok) break;
+    growPelletChunk(chunk, count);
+    ok = readSnapshot(reader, chunk->x, sizeof(float) * count) &&
+         readSnapshot(reader, chunk->y, sizeof(float) * count);
+    chunk->count = count;
+    field->count += count;
+  }
+  if (ok && header.deadCount > 0) {
+    field->deadCapacity = header.deadCount;
+    field->deadEnd = header.deadCount;
+    field->deadX = malloc(sizeof(float) * header.deadCount);
+    field->deadY = malloc(sizeof(float) * header.deadCount);
+    ok = readSnapshot(reader, field->deadX, sizeof(float) * header.deadCount) &&
+         readSnapshot(reader, field->deadY, sizeof(float) * header.deadCount);
+  }
+  return ok;
+}
+
+typedef struct {
+  FILE* file;
+  Replay input;             // Encodes the ticks of the current chunk
+  SessionHeader header;
+  SessionKeyframe* keyframes;
+  uint32_t keyframeCapacity;
+} SessionWriter;
+
+void padSession(FILE* file) {
+  while (ftell(file) % 8 != 0) fputc(0, file);
+}
+
+bool startSession(SessionWriter* writer, const char* path, float dt, int interval) {
+  *writer = (SessionWriter){
+    .header = {
+      .magic = "SNKS",
+      .version = SESSION_VERSION,
+      .keyframeInterval = interval > 0 ? interval : SESSION_KEYFRAME_TICKS,
+      .dt = dt,
+    },
+  };
+  writer->file = fopen(path, "wb");
+  if (writer->file == NULL) {
+    fprintf(stderr, "could not write session %s\n", path);
+    return false;
+  }
+  fwrite(&writer->header, sizeof(SessionHeader), 1, writer->file);
+  return true;
+}
+
+void closeSessionChunk(SessionWriter* writer) {
+  if (writer->header.keyframes == 0) return;
+  SessionKeyframe* last = &writer->keyframes[writer->header.keyframes - 1];
+  last->inputBytes = ftell(writer->file) - last->input;
+}
+
+// Appends the input of the next tick, opening a new chunk with a snapshot
+// of world first when a keyframe is due
+void recordSessionTick(SessionWriter* writer, const InputFrame* in, World* world, Camera2D camera) {
+  if (writer->header.ticks % writer->header.keyframeInterval == 0) {
+    closeSessionChunk(writer);
+    padSession(writer->file);
+    if (writer->header.keyframes == writer->keyframeCapacity) {
+      writer->keyframeCapacity = writer->keyframeCapacity ? writer->keyframeCapacity * 2 : 64;
+      writer->keyframes = realloc(writer->keyframes, sizeof(SessionKeyframe) * writer->keyframeCapacity);
+    }
+    SessionKeyframe* keyframe = &writer->keyframes[writer->header.keyframes++];
+    keyframe->tick = writer->header.ticks;
+    keyframe->snapshot = ftell(writer->file);
+    writeWorldSnapshot(writer->file, world, camera);
+    keyframe->input = ftell(writer->file);
+    writer->input = (Replay){ .file = writer->file, .writing = true };
+  }
+  recordTick(&writer->input, in, world);
+  writer->header.ticks++;
+}
+
+void stopSession(SessionWriter* writer, World* world) {
+  closeSessionChunk(writer);
+  padSession(writer->file);
+  writer->header.seekTable = ftell(writer->file);
+  writer->header.checksum = replayChecksum(world);
+  fwrite(writer->keyframes, sizeof(SessionKeyframe), writer->header.keyframes, writer->file);
+  long size = ftell(writer->file);
+  fseek(writer->file, 0, SEEK_SET);
+  fwrite(&writer->header, sizeof(SessionHeader), 1, writer->file);
+  fclose(writer->file);
+  free(writer->keyframes);
+  TraceLog(
+      LOG_INFO, "SESSION: recorded %u ticks, %u keyframes, %ld bytes",
+      writer->header.ticks, writer->header.keyframes, size
+  );
+}
+
+typedef struct {
+  const unsigned char* data;
+  size_t size;
+  const SessionHeader* header;
+  const SessionKeyframe* keyframes;
+  Replay input;             // Decodes the current chunk
+  int chunk;                // Chunk the input belongs to, -1 before a seek
+  int tick;                 // Next tick to play
+} Session;
+
+// Checks every offset and length in the header and seek table against the
+// mapped size, and that the chunks are where seeking expects them, so a
+// truncated or corrupt file is turned away before anything follows them
+bool checkSessionLayout(const Session* session) {
+  const SessionHeader* header = session->header;
+  if (memcmp(header->magic, "SNKS", 4) != 0 || header->version != SESSION_VERSION) return false;
+  if (header->keyframeInterval == 0) return false;
+  uint64_t chunks = ((uint64_t)header->ticks + header->keyframeInterval - 1) / header->keyframeInterval;
+  if (header->keyframes != chunks) return false;
+
+  // Written 8-byte aligned, and read in place
+  uint64_t table = header->seekTable;
+  if (table % 8 != 0 || table > session->size) return false;
+  if (header->keyframes > (session->size - table) / sizeof(SessionKeyframe)) return false;
+
+  const SessionKeyframe* keyframes = (const SessionKeyframe*)(session->data + table);
+  for (uint32_t k = 0; k < header->keyframes; k++) {
+    const SessionKeyframe* keyframe = &keyframes[k];
+    if (keyframe->tick != (uint64_t)k * header->keyframeInterval) return false;
+    if (keyframe->snapshot < sizeof(SessionHeader) || keyframe->snapshot % 8 != 0) return false;
+    if (keyframe->snapshot > keyframe->input || keyframe->input > table) return false;
+    if (keyframe->inputBytes == 0 || keyframe->inputBytes > table - keyframe->input) return false;
+  }
+  return true;
+}
+
+bool openSession(Session* session, const char* path) {
+  *session = (Session){ .chunk = -1 };
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SessionHeader)) {
+    fprintf(stderr, "could not read session %s\n", path);
+    if (fd >= 0) close(fd);
+    return false;
+  }
+  void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "could not map session %s\n", path);
+    return false;
+  }
+
+  session->data = data;
+  session->size = st.st_size;
+  session->header = data;
+  if (!checkSessionLayout(session)) {
+    fprintf(stderr, "not a session: %s\n", path);
+    munmap(data, st.st_size);
+    return false;
+  }
+  session->keyframes = (const SessionKeyframe*)(session->data + session->header->seekTable);
+  return true;
+}
+
+void closeSession(Session* session) {
+  if (session->input.file != NULL) fclose(session->input.file);
+  munmap((void*)session->data, session->size);
+}
+
+// Points the input decoder at the start of a chunk's ticks
+bool openSessionChunk(Session* session, int chunk) {
+  if (chunk < 0 || chunk >= (int)session->header->keyframes) return false;
+  const SessionKeyframe* keyframe = &session->keyframes[chunk];
+  if (session->input.file != NULL) fclose(session->input.file);
+  session->input = (Replay){
+    .file = fmemopen((void*)(session->data + keyframe->input), keyframe->inputBytes, "rb"),
+    .ticks = session->header->ticks - keyframe->tick,
+    .firstMismatch = -1,
+  };
+  if (session->input.ticks > (int)session->header->keyframeInterval) {
+    session->input.ticks = session->header->keyframeInterval;
+  }
+  session->chunk = chunk;
+  return session->input.file != NULL;
+}
+
+// Plays the next tick. Crossing into the next chunk only switches the
+// input decoder, the world carries on from the simulation.
+bool playSessionTick(Session* session, World* world, Camera2D* camera) {
+  if (session->chunk < 0 || session->tick >= (int)session->header->ticks) return false;
+  if (session->input.tick == session->input.ticks) {
+    if (!openSessionChunk(session, session->chunk + 1)) return false;
+  }
+
+  InputFrame input;
+  int mismatches = session->input.mismatches;
+  if (!playTick(&session->input, &input, world)) return false;
+  if (session->input.mismatches != mismatches) {
+    TraceLog(LOG_WARNING, "SESSION: checksum differs before tick %d", session->tick);
+  }
+  tickGame(camera, world, &input, session->header->dt);
+  session->tick++;
+  return true;
+}
+
+// Loads the keyframe at or before tick and simulates up to it
+bool seekSession(Session* session, World* world, Camera2D* camera, int tick) {
+  if (tick < 0 || tick > (int)session->header->ticks || session->header->keyframes == 0) return false;
+  int chunk = tick / session->header->keyframeInterval;
+  if (chunk >= (int)session->header->keyframes) chunk = session->header->keyframes - 1;
+  const SessionKeyframe* keyframe = &session->keyframes[chunk];
+  SnapshotReader reader = { session->data + keyframe->snapshot, session->data + keyframe->input };
+  if (!loadWorldSnapshot(world, camera, &reader)) return false;
+
+  if (!openSessionChunk(session, chunk)) return false;
+  session->tick = keyframe->tick;
+  while (session->tick < tick) {
+    if (!playSessionTick(session, world, camera)) return false;
+  }
+  return true;
+}
+
+// Seeks a session to a tick, headless, then plays it to the end and checks
+// the final state, as a seek test and a benchmark fed by real games.
+// Returns false when the session did not reproduce.
+bool runSession(const char* path, int seek, JobSystem* jobs) {
+  Session session;
+  if (!openSession(&session, path)) return false;
+
+  World world;
+  initWorld(&world, 1, 1);
+  world.jobs = jobs;
+  Camera2D camera = { .zoom = 1.0 };
+
+  double t0 = nowSeconds();
+  bool ok = seekSession(&session, &world, &camera, seek);
+  double seekTime = nowSeconds() - t0;
+  if (!ok) {
+    fprintf(stderr, "could not seek to tick %d of %u\n", seek, session.header->ticks);
+    freeWorld(&world);
+    closeSession(&session);
+    return false;
+  }
+
+  t0 = nowSeconds();
+  int played = 0;
+  for (;;) {
+    double frameStart = nowSeconds();
+    if (!playSessionTick(&session, &world, &camera)) break;
+    profiler.current[PHASE_FRAME] += nowSeconds() - frameStart;
+    profileEndFrame();
+    played++;
+  }
+  double elapsed = nowSeconds() - t0;
+  bool reproduced = session.tick == (int)session.header->ticks &&
+                    replayChecksum(&world) == session.header->checksum;
+
+  printf("ticks       %u (dt %g), keyframe every %u\n",
+         session.header->ticks, session.header->dt, session.header->keyframeInterval);
+  printf("seek        tick %d in %.3f ms\n", seek, seekTime * 1e3);
+  printf("played      %d ticks\n", played);
+  printf("snakes      %d\n", world.aliveCount);
+  printf("checksum    %016lx\n", replayChecksum(&world));
+  printf("session     %s\n", reproduced ? "reproduced" : "diverged");
+  if (played > 0) {
+    printf("throughput  %.0f ticks/s, %.1f ns/tick\n", played / elapsed, elapsed * 1e9 / played);
+    printf("\nlast %d ticks\n", played < PROFILE_FRAMES ? played : PROFILE_FRAMES);
+    printProfile(stdout);
+  }
+
+  freeWorld(&world);
+  closeSession(&session);
+  return reproduced;
+}
+
+// Single-snake save files for quick restarts, crash recovery and test
+// fixtures: the x, y and length arrays tail first, then a SnakeFileTrailer.
+// With the trailer at the end the whole file is read straight into what
+// becomes the body's block, x first, and the arrays are then slid apart to
+// the ring's power-of-two stride in place. Host byte order.
+#define SNAKE_FILE_VERSION 1
+#define SNAKE_FILE_ARRAYS 3
+
+typedef struct {
+  SnapshotSnake snake;
+  uint32_t version;
+  char magic[4];            // "SNK1"
+} SnakeFileTrailer;
+
+// Writes one ring array tail first, in at most two pieces
+void writeSnakeArray(FILE* file, const SnakeBody* body, const float* src) {
+  int first = body->capacity - body->start;
+  if (first >= body->count) {
+    fwrite(src + body->start, sizeof(float), body->count, file);
+    return;
+  }
+  fwrite(src + body->start, sizeof(float), first, file);
+  fwrite(src, sizeof(float), body->count - first, file);
+}
+
+bool saveSnake(const Snake* snake, const char* path) {
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) {
+    TraceLog(LOG_WARNING, "SNAKE: could not write %s", path);
+    return false;
+  }
+  const SnakeBody* body = &snake->body;
+  writeSnakeArray(file, body, body->x);
+  writeSnakeArray(file, body, body->y);
+  writeSnakeArray(file, body, body->length);
+
+  SnakeFileTrailer trailer = {
+    .snake = {
+      .count = body->count,
+      .thickness = snake->thickness,
+      .movement_direction = snake->movement_direction,
+      .look_direction = snake->look_direction,
+      .boost_time = snake->boost_time,
+      .current_speed = snake->current_speed,
+    },
+    .version = SNAKE_FILE_VERSION,
+    .magic = "SNK1",
+  };
+  fwrite(&trailer, sizeof(trailer), 1, file);
+  bool ok = fclose(file) == 0;
+  if (ok) TraceLog(LOG_INFO, "SNAKE: saved %d parts to %s", body->count, path);
+  return ok;
+}
+
+// Replaces snake with the one saved at path, using a single read. The
+// previous positions are set to the loaded ones.
+bool loadSnake(Snake* snake, const char* path) {
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    TraceLog(LOG_WARNING, "SNAKE: could not read %s", path);
+    if (fd >= 0) close(fd);
+    return false;
+  }
+  long arrayBytes = st.st_size - (long)sizeof(SnakeFileTrailer);
+  long count = arrayBytes / (sizeof(float) * SNAKE_FILE_ARRAYS);
+  // The capacity below doubles as an int, which overflows past 2^30
+  if (arrayBytes < 0 || count * (long)sizeof(float) * SNAKE_FILE_ARRAYS != arrayBytes ||
+      count < 1 || count > 1 << 30) {
+    TraceLog(LOG_WARNING, "SNAKE: %s is not a snake file", path);
+    close(fd);
+    return false;
+  }
+
+  int capacity = 64;
+  while (capacity < count) capacity *= 2;
+  size_t blockBytes = sizeof(float) * capacity * SNAKE_BODY_ARRAYS;
+  if (blockBytes < (size_t)st.st_size) blockBytes = st.st_size;
+  float* block = malloc(blockBytes);
+  ssize_t got = read(fd, block, st.st_size);
+  close(fd);
+  if (got != st.st_size) {
+    TraceLog(LOG_WARNING, "SNAKE: could not read %s", path);
+    free(block);
+    return false;
+  }
+
+  SnakeFileTrailer trailer;
+  memcpy(&trailer, (char*)block + arrayBytes, sizeof(trailer));
+  if (memcmp(trailer.magic, "SNK1", 4) != 0 ||
+      trailer.version != SNAKE_FILE_VERSION || trailer.snake.count != count) {
+    TraceLog(LOG_WARNING, "SNAKE: %s is not a snake file", path);
+    free(block);
+    return false;
+  }
+
+  // Last array first, each only moves up, so nothing is overwritten
+  // before it has been moved
+  for (int a = SNAKE_FILE_ARRAYS - 1; a > 0; a--) {
+    memmove(block + a * capacity, block + a * count, sizeof(float) * count);
+  }
+
+  freeSnakeBody(&snake->body);
+  *snake = (Snake){
+    .body = { .capacity = capacity, .count = count },
+    .thickness = trailer.snake.thickness,
+    .movement_direction = trailer.snake.movement_direction,
+    .look_direction = trailer.snake.look_direction,
+    .boost_time = trailer.snake.boost_time,
+    .current_speed = trailer.snake.current_speed,
+  };
+  float** arrays[SNAKE_BODY_ARRAYS];
+  snakeBodyArrays(&snake->body, arrays);
+  for (int a = 0; a < SNAKE_BODY_ARRAYS; a++) *arrays[a] = block + a * capacity;
+  snapshotSnakeBody(&snake->body);
+
+  snakeBodyStats.allocations++;
+  snakeBodyStats.free += capacity;
+  countSnakeParts(count);
+  return true;
+}
+
+// Multiplayer over UDP. The server runs the one authoritative World at
+// the fixed tick: clients send the InputFrame for each tick, the server
+// applies the newest one to their snake with applyInput, exactly as the
+// local game does for its player, and every NET_STATE_TICKS it sends each
+// client the snakes around its head. Packets are little structs written
+// field by field in host byte order, so client and server must share an
+// architecture; everything runs on localhost for now.
+#define NET_MAX_PACKET 1400      // Stays under a typical MTU
+#define NET_MAX_CLIENTS 1024
+#define NET_STATE_TICKS 3        // 20 states a second at 60 ticks
+#define NET_TIMEOUT 5.0          // Seconds of silence before a client is dropped
+#define NET_VIEW_RADIUS 1500     // World units around a client's head it is sent
+
+enum {
+  NET_HELLO = 1,  // Client wants a snake
+  NET_WELCOME,    // Server: slot, generation
+  NET_INPUT,      // Client: sequence, newest complete state, InputFrame
+  NET_STATE,      // Server: tick, acked input sequence, your slot, baseline
+                  // tick, fragment and last flag, then encoded snakes
+  NET_BYE,        // Client leaves
+};
+
+// Cursor over a packet buffer. Writes past the end are dropped and reads
+// past it return zeros, and ok says whether either happened.
+typedef struct {
+  unsigned char* data;
+  int size;
+  int at;
+  bool ok;
+} Packet;
+
+void packBytes(Packet* packet, const void* src, int size) {
+  if (packet->at + size > packet->size) {
+    packet->ok = false;
+    return;
+  }
+  memcpy(packet->data + packet->at, src, size);
+  packet->at += size;
+}
+
+void unpackBytes(Packet* packet, void* dst, int size) {
+  if (packet->at + size > packet->size) {
+    packet->ok = false;
+    memset(dst, 0, size);
+    return;
+  }
+  memcpy(dst, packet->data + packet->at, size);
+  packet->at += size;
+}
+
+void packU8(Packet* packet, uint8_t v) { packBytes(packet, &v, sizeof(v)); }
+void packU16(Packet* packet, uint16_t v) { packBytes(packet, &v, sizeof(v)); }
+void packU32(Packet* packet, uint32_t v) { packBytes(packet, &v, sizeof(v)); }
+void packF32(Packet* packet, float v) { packBytes(packet, &v, sizeof(v)); }
+uint8_t unpackU8(Packet* packet) { uint8_t v; unpackBytes(packet, &v, sizeof(v)); return v; }
+uint16_t unpackU16(Packet* packet) { uint16_t v; unpackBytes(packet, &v, sizeof(v)); return v; }
+uint32_t unpackU32(Packet* packet) { uint32_t v; unpackBytes(packet, &v, sizeof(v)); return v; }
+float unpackF32(Packet* packet) { float v; unpackBytes(packet, &v, sizeof(v)); return v; }
+
+void packInput(Packet* packet, uint32_t sequence, uint32_t stateAck, const InputFrame* in) {
+  packU8(packet, NET_INPUT);
+  packU32(packet, sequence);
+  packU32(packet, stateAck);
+  packU8(packet, in->gamepad);
+  for (int a = 0; a < 6; a++) packF32(packet, in->axes[a]);
+  packU32(packet, in->buttons_down);
+  packU32(packet, in->buttons_pressed);
+  packF32(packet, in->mouse.x);
+  packF32(packet, in->mouse.y);
+  packF32(packet, in->screen.x);
+  packF32(packet, in->screen.y);
+  packU32(packet, in->keys);
+}
+
+// After the type byte
+uint32_t unpackInput(Packet* packet, uint32_t* stateAck, InputFrame* in) {
+  uint32_t sequence = unpackU32(packet);
+  *stateAck = unpackU32(packet);
+  in->gamepad = unpackU8(packet);
+  for (int a = 0; a < 6; a++) in->axes[a] = unpackF32(packet);
+  in->buttons_down = unpackU32(packet);
+  in->buttons_pressed = unpackU32(packet);
+  in->mouse.x = unpackF32(packet);
+  in->mouse.y = unpackF32(packet);
+  in->screen.x = unpackF32(packet);
+  in->screen.y = unpackF32(packet);
+  in->keys = unpackU32(packet);
+  return sequence;
+}
+
+int openUdpSocket(int port) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) return -1;
+  int buffer = 4 << 20;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+  setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+  struct sockaddr_in addr = {
+    .sin_family = AF_INET,
+    .sin_port = htons(port),
+    .sin_addr.s_addr = htonl(INADDR_ANY),
+  };
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+bool parseAddress(const char* text, struct sockaddr_in* addr) {
+  char host[64];
+  int port;
+  if (sscanf(text, "%63[^:]:%d", host, &port) != 2) return false;
+  *addr = (struct sockaddr_in){ .sin_family = AF_INET, .sin_port = htons(port) };
+  return inet_pton(AF_INET, host, &addr->sin_addr) == 1;
+}
+
+// Bodies are replicated as quantized snapshots. A snake is sent head
+// first: the head's direction, speed and thickness, then every part as a
+// residual against a prediction, bit-packed in blocks of NET_BLOCK parts
+// that are one bit when all zero and otherwise carry a bit width per axis.
+// With a baseline, the last state the client acked, part k is predicted by
+// the same part of the baseline or, block by block, by part k - shift: with
+// a follow gain of 1 a moving part takes its successor's place, so behind
+// the head the body is the baseline slid down by the ticks in between and
+// further back, where the pull has not reached yet, it has not moved at
+// all. Either way most residuals are exactly zero. Parts with nothing in
+// the baseline to go by are predicted from the parts before them.
+#define NET_QUANT 8              // Steps per world unit
+#define NET_BASELINES 16         // States kept to delta against, 0.8 s at 60 ticks
+#define NET_MAX_SHIFT 127        // Furthest a baseline is slid, fits 7 bits
+#define NET_BLOCK 16
+
+typedef struct {
+  int first;                 // Index of the head in x and y, -1 when absent
+  int count;
+  unsigned int generation;   // Only known to the server
+  uint16_t angle;            // Of movement_direction, 4096 steps per turn
+  uint16_t speed;            // 64 steps per unit
+  uint16_t thickness;        // 64 steps per unit
+} NetSnake;
+
+// The snakes in one state, by slot, as one side knows them
+typedef struct {
+  uint32_t tick;             // 0 while empty
+  NetSnake* snakes;
+  int slotCapacity;
+  int32_t* x;
+  int32_t* y;
+  int used;
+  int capacity;
+} NetFrame;
+
+void clearNetFrame(NetFrame* frame, uint32_t tick) {
+  frame->tick = tick;
+  frame->used = 0;
+  for (int s = 0; s < frame->slotCapacity; s++) frame->snakes[s].first = -1;
+}
+
+void freeNetFrame(NetFrame* frame) {
+  free(frame->snakes);
+  free(frame->x);
+  free(frame->y);
+  *frame = (NetFrame){0};
+}
+
+// Room for count parts in slot, whose previous contents are dropped
+NetSnake* addNetSnake(NetFrame* frame, int slot, int count) {
+  if (slot >= frame->slotCapacity) {
+    int capacity = frame->slotCapacity ? frame->slotCapacity : 64;
+    while (capacity <= slot) capacity *= 2;
+    frame->snakes = realloc(frame->snakes, sizeof(NetSnake) * capacity);
+    for (int s = frame->slotCapacity; s < capacity; s++) frame->snakes[s].first = -1;
+    frame->slotCapacity = capacity;
+  }
+  if (frame->used + count > frame->capacity) {
+    int capacity = frame->capacity ? frame->capacity : 4096;
+    while (capacity < frame->used + count) capacity *= 2;
+    frame->x = realloc(frame->x, sizeof(int32_t) * capacity);
+    frame->y = realloc(frame->y, sizeof(int32_t) * capacity);
+    frame->capacity = capacity;
+  }
+  NetSnake* snake = &frame->snakes[slot];
+  *snake = (NetSnake){ .first = frame->used, .count = count };
+  frame->used += count;
+  return snake;
+}
+
+NetSnake* findNetSnake(NetFrame* frame, int slot) {
+  if (frame == NULL || slot >= frame->slotCapacity) return NULL;
+  return frame->snakes[slot].first >= 0 ? &frame->snakes[slot] : NULL;
+}
+
+uint16_t quantizeUnit(float v, float steps) {
+  return (uint16_t)Clamp(roundf(v * steps), 0, 65535);
+}
+
+void captureNetSnake(NetFrame* frame, int slot, const Snake* snake, unsigned int generation) {
+  const SnakeBody* body = &snake->body;
+  NetSnake* out = addNetSnake(frame, slot, body->count);
+  float angle = atan2f(snake->movement_direction.y, snake->movement_direction.x);
+  out->generation = generation;
+  out->angle = (int)roundf(angle / (2 * PI) * 4096) & 4095;
+  out->speed = quantizeUnit(snake->current_speed, 64);
+  out->thickness = quantizeUnit(snake->thickness, 64);
+  int32_t* x = frame->x + out->first;
+  int32_t* y = frame->y + out->first;
+  for (int k = 0; k < body->count; k++) {
+    int j = snakePartIndex(body, body->count - 1 - k);
+    x[k] = (int32_t)lrintf(body->x[j] * NET_QUANT);
+    y[k] = (int32_t)lrintf(body->y[j] * NET_QUANT);
+  }
+}
+
+// The server's view of every live snake at tick
+void captureNetFrame(NetFrame* frame, World* world, uint32_t tick) {
+  clearNetFrame(frame, tick);
+  for (int s = 0; s < world->slotCount; s++) {
+    if (world->alive[s]) captureNetSnake(frame, s, &world->snakes[s], world->generation[s]);
+  }
+}
+
+// Bit cursor over a buffer, least significant bit first. Like Packet, ok
+// turns false on overrun and reads past the end return zeros.
+typedef struct {
+  unsigned char* data;
+  long size;                 // Bytes
+  long bit;
+  bool ok;
+} BitStream;
+
+void writeBits(BitStream* stream, uint32_t value, int bits) {
+  if (stream->bit + bits > stream->size * 8) {
+    stream->ok = false;
+    return;
+  }
+  for (int done = 0; done < bits;) {
+    long byte = stream->bit >> 3;
+    int offset = stream->bit & 7;
+    int take = 8 - offset < bits - done ? 8 - offset : bits - done;
+    unsigned char mask = ((1u << take) - 1) << offset;
+    stream->data[byte] = (stream->data[byte] & ~mask) | (((value >> done) << offset) & mask);
+    stream->bit += take;
+    done += take;
+  }
+}
+
+uint32_t readBits(BitStream* stream, int bits) {
+  if (stream->bit + bits > stream->size * 8) {
+    stream->ok = false;
+    return 0;
+  }
+  uint32_t value = 0;
+  for (int done = 0; done < bits;) {
+    long byte = stream->bit >> 3;
+    int offset = stream->bit & 7;
+    int take = 8 - offset < bits - done ? 8 - offset : bits - done;
+    value |= (uint32_t)((stream->data[byte] >> offset) & ((1u << take) - 1)) << done;
+    stream->bit += take;
+    done += take;
+  }
+  return value;
+}
+
+// Overwrites bits already written at bit
+void patchBits(BitStream* stream, long bit, uint32_t value, int bits) {
+  long end = stream->bit;
+  stream->bit = bit;
+  writeBits(stream, value, bits);
+  stream->bit = end;
+}
+
+uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+int32_t unzigzag(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+int bitWidth(uint32_t v) {
+  return v ? 32 - __builtin_clz(v) : 0;
+}
+
+// Where part k of a snake is expected, given the parts from begin to k - 1
+// already known in x and y and, if there is one, the baseline slid by shift
+void predictPart(
+    const int32_t* x, const int32_t* y, int k, int begin,
+    const int32_t* baseX, const int32_t* baseY, int baseCount, int shift,
+    int32_t* px, int32_t* py
+) {
+  int b = k - shift;
+  if (baseX != NULL && b >= 0 && b < baseCount) {
+    *px = baseX[b];
+    *py = baseY[b];
+  }
+  else if (b < 0 && k - 2 >= begin) {
+    // Trail laid by the head since the baseline: keep going the same way
+    *px = 2 * x[k - 1] - x[k - 2];
+    *py = 2 * y[k - 1] - y[k - 2];
+  }
+  else if (k - 1 >= begin) {
+    // Parts grown onto the tail start out on top of it
+    *px = x[k - 1];
+    *py = y[k - 1];
+  }
+  else if (baseX != NULL && baseCount > 0) {
+    int nearest = b < 0 ? 0 : baseCount - 1;
+    *px = baseX[nearest];
+    *py = baseY[nearest];
+  }
+  else {
+    *px = 0;
+    *py = 0;
+  }
+}
+
+// How far the baseline's head has moved down the body: the part now
+// closest to where the head was
+int chooseShift(const NetFrame* frame, const NetSnake* snake, const NetFrame* base, const NetSnake* baseSnake) {
+  int32_t hx = base->x[baseSnake->first];
+  int32_t hy = base->y[baseSnake->first];
+  const int32_t* x = frame->x + snake->first;
+  const int32_t* y = frame->y + snake->first;
+  int last = snake->count - 1 < NET_MAX_SHIFT ? snake->count - 1 : NET_MAX_SHIFT;
+  int best = 0;
+  long bestDistance = -1;
+  for (int k = 0; k <= last; k++) {
+    long distance = labs((long)x[k] - hx) + labs((long)y[k] - hy);
+    if (bestDistance < 0 || distance < bestDistance) {
+      best = k;
+      bestDistance = distance;
+    }
+  }
+  return best;
+}
+
+#define NET_ENTRY_BITS (1 + 16 + 24 * 3 + 1 + 7 + 12 + 16 + 16)
+
+typedef struct {
+  uint32_t x[NET_BLOCK];
+  uint32_t y[NET_BLOCK];
+  int widthX;
+  int widthY;
+  long bits;                 // Encoded size, past the slide bit
+} NetBlock;
+
+// Residuals of parts k to k + n - 1 against their prediction
+void residualBlock(
+    NetBlock* block, const int32_t* x, const int32_t* y, int k, int n, int begin,
+    const int32_t* baseX, const int32_t* baseY, int baseCount, int shift
+) {
+  uint32_t orX = 0, orY = 0;
+  for (int i = 0; i < n; i++) {
+    int32_t px, py;
+    predictPart(x, y, k + i, begin, baseX, baseY, baseCount, shift, &px, &py);
+    block->x[i] = zigzag(x[k + i] - px);
+    block->y[i] = zigzag(y[k + i] - py);
+    orX |= block->x[i];
+    orY |= block->y[i];
+  }
+  // Widths go from 0 to 32, so they take 6 bits each
+  block->widthX = bitWidth(orX);
+  block->widthY = bitWidth(orY);
+  block->bits = (orX | orY) ? 13 + n * (block->widthX + block->widthY) : 1;
+}
+
+// Writes parts of a snake from begin on, as many whole blocks as fit in
+// the stream, and returns how many that was, 0 if not even one. baseSnake
+// is NULL for a keyframe.
+int encodeNetSnake(
+    BitStream* stream, int slot, const NetFrame* frame, const NetSnake* snake,
+    const NetFrame* base, const NetSnake* baseSnake, int shift, int begin
+) {
+  long limit = stream->size * 8 - 1;  // Room for the final end marker
+  if (stream->bit + NET_ENTRY_BITS > limit) return 0;
+  long start = stream->bit;
+  writeBits(stream, 1, 1);
+  writeBits(stream, slot, 16);
+  writeBits(stream, snake->count, 24);
+  writeBits(stream, begin, 24);
+  long countBit = stream->bit;
+  writeBits(stream, 0, 24);
+  writeBits(stream, baseSnake != NULL, 1);
+  if (baseSnake != NULL) writeBits(stream, shift, 7);
+  if (begin == 0) {
+    writeBits(stream, snake->angle, 12);
+    writeBits(stream, snake->speed, 16);
+    writeBits(stream, snake->thickness, 16);
+  }
+
+  const int32_t* x = frame->x + snake->first;
+  const int32_t* y = frame->y + snake->first;
+  const int32_t* baseX = baseSnake ? base->x + baseSnake->first : NULL;
+  const int32_t* baseY = baseSnake ? base->y + baseSnake->first : NULL;
+  int baseCount = baseSnake ? baseSnake->count : 0;
+
+  int k = begin;
+  while (k < snake->count) {
+    int n = snake->count - k < NET_BLOCK ? snake->count - k : NET_BLOCK;
+    NetBlock still, slid;
+    residualBlock(&still, x, y, k, n, begin, baseX, baseY, baseCount, 0);
+    NetBlock* block = &still;
+    if (baseSnake != NULL) {
+      residualBlock(&slid, x, y, k, n, begin, baseX, baseY, baseCount, shift);
+      if (slid.bits < still.bits) block = &slid;
+    }
+    if (stream->bit + (baseSnake != NULL) + block->bits > limit) break;
+
+    if (baseSnake != NULL) writeBits(stream, block == &slid, 1);
+    writeBits(stream, block->bits > 1, 1);
+    if (block->bits > 1) {
+      writeBits(stream, block->widthX, 6);
+      writeBits(stream, block->widthY, 6);
+      for (int i = 0; i < n; i++) writeBits(stream, block->x[i], block->widthX);
+      for (int i = 0; i < n; i++) writeBits(stream, block->y[i], block->widthY);
+    }
+    k += n;
+  }
+
+  if (k == begin) {
+    stream->bit = start;
+    return 0;
+  }
+  patchBits(stream, countBit, k - begin, 24);
+  return k - begin;
+}
+
+// Reads the entry encodeNetSnake wrote, after its leading 1 bit, into
+// frame. base is the frame the entry was encoded against. Returns the slot,
+// or -1 when the entry is broken or its baseline is missing.
+int decodeNetSnake(BitStream* stream, NetFrame* frame, NetFrame* base) {
+  int slot = readBits(stream, 16);
+  int count = readBits(stream, 24);
+  int begin = readBits(stream, 24);
+  int n = readBits(stream, 24);
+  bool delta = readBits(stream, 1);
+  int shift = delta ? (int)readBits(stream, 7) : 0;
+  if (!stream->ok || begin + n > count) return -1;
+
+  NetSnake* snake = findNetSnake(frame, slot);
+  if (snake == NULL || snake->count != count) snake = addNetSnake(frame, slot, count);
+  if (begin == 0) {
+    snake->angle = readBits(stream, 12);
+    snake->speed = readBits(stream, 16);
+    snake->thickness = readBits(stream, 16);
+  }
+
+  NetSnake* baseSnake = delta ? findNetSnake(base, slot) : NULL;
+  if (delta && baseSnake == NULL) return -1;
+  int32_t* x = frame->x + snake->first;
+  int32_t* y = frame->y + snake->first;
+  const int32_t* baseX = baseSnake ? base->x + baseSnake->first : NULL;
+  const int32_t* baseY = baseSnake ? base->y + baseSnake->first : NULL;
+  int baseCount = baseSnake ? baseSnake->count : 0;
+
+  for (int k = begin; k < begin + n; k += NET_BLOCK) {
+    int m = begin + n - k < NET_BLOCK ? begin + n - k : NET_BLOCK;
+    int blockShift = delta && readBits(stream, 1) ? shift : 0;
+    uint32_t rx[NET_BLOCK] = {0}, ry[NET_BLOCK] = {0};
+    if (readBits(stream, 1)) {
+      int wx = readBits(stream, 6);
+      int wy = readBits(stream, 6);
+      for (int i = 0; i < m; i++) rx[i] = readBits(stream, wx);
+      for (int i = 0; i < m; i++) ry[i] = readBits(stream, wy);
+    }
+    for (int i = 0; i < m; i++) {
+      int32_t px, py;
+      predictPart(x, y, k + i, begin, baseX, baseY, baseCount, blockShift, &px, &py);
+      x[k + i] = px + unzigzag(rx[i]);
+      y[k + i] = py + unzigzag(ry[i]);
+    }
+  }
+  return stream->ok ? slot : -1;
+}
+
+// Bytes per snake on the wire at several lengths, against a baseline acked
+// one and four states back and as a keyframe, next to the raw floats the
+// first protocol sent. Every encoded state is decoded again and compared.
+// At 240 ticks a second followGain is below 1, so the body no longer
+// shifts by whole parts and the slid baseline predicts it less well.
+// Prints one CSV row per scenario.
+void benchNet() {
+  const int rates[] = {TICK_RATE, 240};
+  const int sizes[] = {50, 500, 5000, 50000};
+  const int lags[] = {1, 4};
+  const int states = 200;
+  long bufferSize = 1 << 22;
+  unsigned char* buffer = malloc(bufferSize);
+
+  printf("tick_rate,parts,motion,ack_lag,raw_bytes,keyframe_bytes,delta_bytes,delta_bytes_per_tick,mismatches\n");
+  for (int r = 0; r < (int)(sizeof(rates) / sizeof(rates[0])); r++) {
+    const float dt = 1.0 / rates[r];
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+      for (int turning = 0; turning <= 1; turning++) {
+        for (int l = 0; l < (int)(sizeof(lags) / sizeof(lags[0])); l++) {
+          Camera2D camera = { .zoom = 1.0 };
+          Snake snake;
+          initSnake(&snake, (Vector2){0, 0}, (Vector2){1, 0}, sizes[s]);
+          NetFrame frames[NET_BASELINES] = {0};
+          NetFrame decoded = {0};
+          long raw = 0, keyframe = 0, delta = 0, mismatches = 0, encoded = 0;
+
+          for (int tick = 1; tick <= states * NET_STATE_TICKS; tick++) {
+            float t = tick * dt;
+            InputFrame in = { .gamepad = true, .screen = {WINDOW_WIDTH, WINDOW_HEIGHT} };
+            in.axes[GAMEPAD_AXIS_LEFT_X] = turning ? cosf(t * 2) : 1;
+            in.axes[GAMEPAD_AXIS_LEFT_Y] = turning ? sinf(t * 2) : 0;
+            in.axes[GAMEPAD_AXIS_LEFT_TRIGGER] = -1;
+            if (tick % 10 == 0) in.buttons_pressed |= 1u << GAMEPAD_BUTTON_RIGHT_FACE_DOWN;
+            applyInput(&camera, &snake, &in, dt);
+            while (snake.body.count > sizes[s]) popSnakeTail(&snake);
+            moveSnake(&snake, dt);
+            if (tick % NET_STATE_TICKS != 0) continue;
+
+            int state = tick / NET_STATE_TICKS;
+            NetFrame* frame = &frames[state % NET_BASELINES];
+            clearNetFrame(frame, tick);
+            captureNetSnake(frame, 0, &snake, 0);
+            if (state <= lags[l]) continue;
+            NetFrame* base = &frames[(state - lags[l]) % NET_BASELINES];
+
+            NetSnake* current = findNetSnake(frame, 0);
+            NetSnake* baseSnake = findNetSnake(base, 0);
+            BitStream stream = { buffer, bufferSize, 0, true };
+            encodeNetSnake(&stream, 0, frame, current, NULL, NULL, 0, 0);
+            keyframe += (stream.bit + 7) / 8;
+
+            stream.bit = 0;
+            int shift = chooseShift(frame, current, base, baseSnake);
+            encodeNetSnake(&stream, 0, frame, current, base, baseSnake, shift, 0);
+            writeBits(&stream, 0, 1);
+            delta += (stream.bit + 7) / 8;
+            raw += 28 + current->count * 8;
+            encoded++;
+
+            BitStream reader = { buffer, bufferSize, 0, true };
+            clearNetFrame(&decoded, tick);
+            while (readBits(&reader, 1)) decodeNetSnake(&reader, &decoded, base);
+            NetSnake* got = findNetSnake(&decoded, 0);
+            if (got == NULL || got->count != current->count ||
+                memcmp(decoded.x + got->first, frame->x + current->first, sizeof(int32_t) * current->count) ||
+                memcmp(decoded.y + got->first, frame->y + current->first, sizeof(int32_t) * current->count)) {
+              mismatches++;
+            }
+          }
+
+          printf(
+              "%d,%d,%s,%d,%.1f,%.1f,%.1f,%.2f,%ld\n",
+              rates[r], sizes[s], turning ? "turning" : "straight", lags[l],
+              (double)raw / encoded, (double)keyframe / encoded, (double)delta / encoded,
+              (double)delta / encoded / NET_STATE_TICKS, mismatches
+          );
+          for (int f = 0; f < NET_BASELINES; f++) freeNetFrame(&frames[f]);
+          freeNetFrame(&decoded);
+          freeSnakeBody(&snake.body);
+        }
+      }
+    }
+  }
+  free(buffer);
+}
+
+typedef struct {
+  bool active;
+  struct sockaddr_in addr;
+  SnakeHandle snake;
+  Camera2D camera;          // Only its zoom matters, applyInput needs one
+  InputFrame input;         // Newest input, reapplied until the next arrives
+  unsigned int pressed;     // Presses since the last tick
+  uint32_t sequence;        // Newest input sequence
+  uint32_t stateAck;        // Newest state the client has whole, 0 for none
+  uint8_t* sentSlots[NET_BASELINES]; // Which snakes each recent state held
+  int sentCapacity;
+  double heard;             // When the last packet arrived
+} NetClient;
+
+typedef struct {
+  int fd;
+  World world;
+  NetClient* clients;
+  int* lookup;              // Open addressing on the address, -1 is empty
+  int lookupSize;           // Power of two, at least twice NET_MAX_CLIENTS
+  int clientCount;
+  uint32_t tick;
+  NetFrame frames[NET_BASELINES]; // States sent, by tick / NET_STATE_TICKS
+  long packetsIn;
+  long packetsOut;
+  long bytesOut;
+} Server;
+
+unsigned int addressHash(const struct sockaddr_in* addr) {
+  unsigned int h = addr->sin_addr.s_addr * 2654435761u ^ addr->sin_port * 40503u;
+  return h ^ (h >> 15);
+}
+
+bool sameAddress(const struct sockaddr_in* a, const struct sockaddr_in* b) {
+  return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+// Index of the client at addr, or -1
+int findClient(Server* server, const struct sockaddr_in* addr) {
+  unsigned int mask = server->lookupSize - 1;
+  for (unsigned int i = addressHash(addr) & mask; ; i = (i + 1) & mask) {
+    int c = server->lookup[i];
+    if (c < 0) return -1;
+    if (server->clients[c].active && sameAddress(&server->clients[c].addr, addr)) return c;
+  }
+}
+
+// Rebuilds the lookup table, which is how removed clients leave it
+void rebuildClientLookup(Server* server) {
+  unsigned int mask = server->lookupSize - 1;
+  for (int i = 0; i < server->lookupSize; i++) server->lookup[i] = -1;
+  for (int c = 0; c < NET_MAX_CLIENTS; c++) {
+    if (!server->clients[c].active) continue;
+    unsigned int i = addressHash(&server->clients[c].addr) & mask;
+    while (server->lookup[i] >= 0) i = (i + 1) & mask;
+    server->lookup[i] = c;
+  }
+}
+
+void sendPacket(Server* server, const struct sockaddr_in* addr, const Packet* packet) {
+  sendto(server->fd, packet->data, packet->at, 0, (const struct sockaddr*)addr, sizeof(*addr));
+  server->packetsOut++;
+  server->bytesOut += packet->at;
+}
+
+void welcomeClient(Server* server, NetClient* client) {
+  unsigned char buffer[16];
+  Packet packet = { buffer, sizeof(buffer), 0, true };
+  packU8(&packet, NET_WELCOME);
+  packU16(&packet, client->snake.slot);
+  packU32(&packet, client->snake.generation);
+  sendPacket(server, &client->addr, &packet);
+}
+
+void addClient(Server* server, const struct sockaddr_in* addr) {
+  if (server->clientCount == NET_MAX_CLIENTS) return;
+  int c = 0;
+  while (server->clients[c].active) c++;
+  server->clients[c] = (NetClient){
+    .active = true,
+    .addr = *addr,
+    .snake = spawnHuman(&server->world, respawnPoint(&server->world)),
+    .camera = { .zoom = 1.0 },
+    .heard = nowSeconds(),
+  };
+  server->clientCount++;
+  rebuildClientLookup(server);
+  welcomeClient(server, &server->clients[c]);
+}
+
+void removeClient(Server* server, int c) {
+  NetClient* client = &server->clients[c];
+  if (resolveSnake(&server->world, client->snake) != NULL) {
+    despawnSnake(&server->world, client->snake.slot);
+  }
+  for (int b = 0; b < NET_BASELINES; b++) free(client->sentSlots[b]);
+  client->active = false;
+  server->clientCount--;
+  rebuildClientLookup(server);
+}
+
+// Makes a client's InputFrame safe to hand to applyInput. Returns false
+// for frames with a non-finite number, which would spread NaN through the
+// snake. Sticks and triggers are clamped to their range, and the grow
+// button, a local debugging aid, is masked off.
+bool acceptNetInput(InputFrame* in) {
+  for (int a = 0; a < 6; a++) {
+    if (!isfinite(in->axes[a])) return false;
+    in->axes[a] = Clamp(in->axes[a], -1, 1);
+  }
+  if (!isfinite(in->mouse.x) || !isfinite(in->mouse.y) ||
+      !isfinite(in->screen.x) || !isfinite(in->screen.y)) {
+    return false;
+  }
+  unsigned int grow = 1u << GAMEPAD_BUTTON_RIGHT_FACE_DOWN;
+  in->buttons_down &= ~grow;
+  in->buttons_pressed &= ~grow;
+  return true;
+}
+
+void receivePackets(Server* server) {
+  unsigned char buffer[NET_MAX_PACKET];
+  for (;;) {
+    struct sockaddr_in addr;
+    socklen_t addrSize = sizeof(addr);
+    int size = recvfrom(server->fd, buffer, sizeof(buffer), 0, (struct sockaddr*)&addr, &addrSize);
+    if (size <= 0) return;
+    server->packetsIn++;
+
+    Packet packet = { buffer, size, 0, true };
+    int type = unpackU8(&packet);
+    int c = findClient(server, &addr);
+    if (type == NET_HELLO) {
+      if (c < 0) addClient(server, &addr);
+      else welcomeClient(server, &server->clients[c]);
+      continue;
+    }
+    if (c < 0) continue;
+
+    NetClient* client = &server->clients[c];
+    client->heard = nowSeconds();
+    if (type == NET_BYE) {
+      removeClient(server, c);
+    }
+    else if (type == NET_INPUT) {
+      InputFrame input;
+      uint32_t stateAck;
+      uint32_t sequence = unpackInput(&packet, &stateAck, &input);
+      if (!packet.ok || !acceptNetInput(&input)) continue;
+      // Late packets are dropped, presses in them are not
+      client->pressed |= input.buttons_pressed;
+      if ((int32_t)(sequence - client->sequence) > 0) {
+        client->sequence = sequence;
+        client->input = input;
+      }
+      if ((int32_t)(stateAck - client->stateAck) > 0) {
+        client->stateAck = stateAck;
+      }
+    }
+  }
+}
+
+#define NET_STATE_HEADER 18
+
+// Starts a NET_STATE packet. Its last flag is set when it is sent.
+void beginState(BitStream* stream, Server* server, NetClient* client, uint32_t baseline, int fragment) {
+  Packet packet = { stream->data, stream->size, 0, true };
+  packU8(&packet, NET_STATE);
+  packU32(&packet, server->tick);
+  packU32(&packet, client->sequence);
+  packU16(&packet, client->snake.slot);
+  packU32(&packet, baseline);
+  packU16(&packet, fragment);
+  packU8(&packet, 0);
+  stream->bit = packet.at * 8;
+  stream->ok = true;
+}
+
+void sendStateFragment(Server* server, NetClient* client, BitStream* stream, bool last) {
+  writeBits(stream, 0, 1);
+  stream->data[NET_STATE_HEADER - 1] = last;
+  Packet packet = { stream->data, stream->size, (stream->bit + 7) / 8, true };
+  sendPacket(server, &client->addr, &packet);
+}
+
+// The frame a client can decode against: the newest state it acked, if
+// the server still has it
+NetFrame* clientBaseline(Server* server, NetClient* client) {
+  uint32_t ack = client->stateAck;
+  if (ack == 0 || server->tick - ack >= NET_BASELINES * NET_STATE_TICKS) return NULL;
+  NetFrame* frame = &server->frames[ack / NET_STATE_TICKS % NET_BASELINES];
+  return frame->tick == ack ? frame : NULL;
+}
+
+// Sends the client every snake that reaches into its view in the current
+// frame, delta encoded against its baseline where it has the same snake
+// there, splitting over as many packets as it takes
+void sendState(Server* server, NetClient* client) {
+  NetFrame* frame = &server->frames[server->tick / NET_STATE_TICKS % NET_BASELINES];
+  NetSnake* own = findNetSnake(frame, client->snake.slot);
+  if (own == NULL) return;
+  float centerX = frame->x[own->first] / (float)NET_QUANT;
+  float centerY = frame->y[own->first] / (float)NET_QUANT;
+
+  NetFrame* base = clientBaseline(server, client);
+  uint8_t* baseSlots = base ? client->sentSlots[base->tick / NET_STATE_TICKS % NET_BASELINES] : NULL;
+  int slots = server->world.slotCount;
+  if (slots > client->sentCapacity) {
+    for (int b = 0; b < NET_BASELINES; b++) {
+      client->sentSlots[b] = realloc(client->sentSlots[b], slots);
+      memset(client->sentSlots[b] + client->sentCapacity, 0, slots - client->sentCapacity);
+    }
+    client->sentCapacity = slots;
+    if (base) baseSlots = client->sentSlots[base->tick / NET_STATE_TICKS % NET_BASELINES];
+  }
+  uint8_t* sent = client->sentSlots[frame->tick / NET_STATE_TICKS % NET_BASELINES];
+  memset(sent, 0, client->sentCapacity);
+
+  unsigned char buffer[NET_MAX_PACKET];
+  BitStream stream = { buffer, sizeof(buffer), 0, true };
+  int fragment = 0;
+  uint32_t baseTick = base ? base->tick : 0;
+  beginState(&stream, server, client, baseTick, fragment);
+
+  for (int s = 0; s < slots; s++) {
+    NetSnake* snake = findNetSnake(frame, s);
+    if (snake == NULL) continue;
+    float dx = frame->x[snake->first] / (float)NET_QUANT - centerX;
+    float dy = frame->y[snake->first] / (float)NET_QUANT - centerY;
+    float reach = NET_VIEW_RADIUS + snake->count * PART_LENGTH * 2;
+    if (dx * dx + dy * dy > reach * reach) continue;
+
+    NetSnake* baseSnake = NULL;
+    if (base != NULL && baseSlots[s]) {
+      baseSnake = findNetSnake(base, s);
+      if (baseSnake != NULL && baseSnake->generation != snake->generation) baseSnake = NULL;
+    }
+    int shift = baseSnake ? chooseShift(frame, snake, base, baseSnake) : 0;
+    for (int begin = 0; begin < snake->count;) {
+      int n = encodeNetSnake(&stream, s, frame, snake, base, baseSnake, shift, begin);
+      if (n == 0) {
+        sendStateFragment(server, client, &stream, false);
+        beginState(&stream, server, client, baseTick, ++fragment);
+        continue;
+      }
+      begin += n;
+    }
+    sent[s] = 1;
+  }
+  sendStateFragment(server, client, &stream, true);
+}
+
+// One authoritative tick: every client's input, the world, respawns
+void tickServer(Server* server, float dt) {
+  World* world = &server->world;
+  double now = nowSeconds();
+  for (int c = 0; c < NET_MAX_CLIENTS; c++) {
+    NetClient* client = &server->clients[c];
+    if (!client->active) continue;
+    if (now - client->heard > NET_TIMEOUT) {
+      removeClient(server, c);
+      continue;
+    }
+    Snake* snake = resolveSnake(world, client->snake);
+    if (snake == NULL) continue;
+    InputFrame input = client->input;
+    input.buttons_pressed = client->pressed;
+    client->pressed = 0;
+    PROFILE_SCOPE(PHASE_INPUT) applyInput(&client->camera, snake, &input, dt);
+  }
+
+  stepWorld(world, dt);
+
+  // Clients whose snake died get a new one and are told its slot
+  for (int c = 0; c < NET_MAX_CLIENTS; c++) {
+    NetClient* client = &server->clients[c];
+    if (!client->active || resolveSnake(world, client->snake) != NULL) continue;
+    client->snake = spawnHuman(world, respawnPoint(world));
+    welcomeClient(server, client);
+  }
+  refillBots(world);
+  server->tick++;
+
+  if (server->tick % NET_STATE_TICKS == 0) {
+    NetFrame* frame = &server->frames[server->tick / NET_STATE_TICKS % NET_BASELINES];
+    captureNetFrame(frame, world, server->tick);
+    for (int c = 0; c < NET_MAX_CLIENTS; c++) {
+      if (server->clients[c].active) sendState(server, &server->clients[c]);
+    }
+  }
+}
+
+void sleepUntil(double when) {
+  double wait = when - nowSeconds();
+  if (wait <= 0) return;
+  struct timespec ts = { (time_t)wait, (long)((wait - (time_t)wait) * 1e9) };
+  nanosleep(&ts, NULL);
+}
+
+// Hosts an arena on port until ticks have run (0 runs forever), logging
+// load every five seconds
+int runServer(int port, int ticks, float dt, int bots, int pellets, JobSystem* jobs) {
+  Server server = {
+    .fd = openUdpSocket(port),
+    .clients = calloc(NET_MAX_CLIENTS, sizeof(NetClient)),
+    .lookupSize = NET_MAX_CLIENTS * 2,
+  };
+  if (server.fd < 0) {
+    fprintf(stderr, "could not bind udp port %d\n", port);
+    free(server.clients);
+    return 1;
+  }
+  server.lookup = malloc(sizeof(int) * server.lookupSize);
+  rebuildClientLookup(&server);
+  initGame(&server.world, bots, pellets);
+  // The local player slot is not needed on a server
+  despawnSnake(&server.world, server.world.player);
+  server.world.jobs = jobs;
+  TraceLog(LOG_INFO, "SERVER: listening on udp port %d", port);
+
+  double next = nowSeconds();
+  double reportAt = next + 5;
+  long bytesReported = 0;
+  for (int tick = 0; ticks == 0 || tick < ticks; tick++) {
+    sleepUntil(next);
+    next += dt;
+    double frameStart = nowSeconds();
+    receivePackets(&server);
+    TRACE_SCOPE("tick") tickServer(&server, dt);
+    profiler.current[PHASE_FRAME] += nowSeconds() - frameStart;
+    profileEndFrame();
+
+    if (frameStart >= reportAt) {
+      PhaseStats frame = profileStats(PHASE_FRAME);
+      TraceLog(
+          LOG_INFO, "SERVER: %d clients, %d snakes, tick avg %.2f ms p99 %.2f ms, %.1f KB/s out",
+          server.clientCount, server.world.aliveCount, frame.avg, frame.p99,
+          (server.bytesOut - bytesReported) / 5.0 / 1024
+      );
+      bytesReported = server.bytesOut;
+      reportAt += 5;
+    }
+  }
+
+  printf("ticks       %u\n", server.tick);
+  printf("clients     %d\n", server.clientCount);
+  printf("packets     %ld in, %ld out\n", server.packetsIn, server.packetsOut);
+  printf("sent        %ld bytes\n", server.bytesOut);
+  printProfile(stdout);
+
+  for (int c = 0; c < NET_MAX_CLIENTS; c++) {
+    if (server.clients[c].active) removeClient(&server, c);
+  }
+  for (int b = 0; b < NET_BASELINES; b++) freeNetFrame(&server.frames[b]);
+  close(server.fd);
+  free(server.clients);
+  free(server.lookup);
+  freeWorld(&server.world);
+  return 0;
+}
+
+typedef struct {
+  int fd;
+  bool welcomed;
+  uint16_t slot;
+  uint32_t sequence;
+  double sent[64];          // Send time by sequence, for round trips
+  NetFrame frames[NET_BASELINES];
+  int fragments[NET_BASELINES];  // Received of each frame's state
+  int total[NET_BASELINES];      // Fragments in it, 0 until the last arrives
+  bool broken[NET_BASELINES];    // Something in it could not be decoded
+  uint32_t stateAck;
+  long packets;
+  long states;              // Complete and decoded
+  long snakes;              // Summed over complete states
+  long bytes;
+  long ownSeen;             // Complete states that held the client's own snake
+  long failures;            // States that could not be decoded
+  double rtt;               // Sum over state packets
+  long rtts;
+} BotClient;
+
+// Decodes one NET_STATE packet into the bot's frames, acking the state
+// once all of its fragments are in
+void receiveState(BotClient* bot, unsigned char* data, int size) {
+  Packet packet = { data, size, 1, true };
+  uint32_t tick = unpackU32(&packet);
+  unpackU32(&packet);
+  unpackU16(&packet);
+  uint32_t baseTick = unpackU32(&packet);
+  int fragment = unpackU16(&packet);
+  bool last = unpackU8(&packet);
+  if (!packet.ok || tick == 0) return;
+
+  int b = tick / NET_STATE_TICKS % NET_BASELINES;
+  NetFrame* frame = &bot->frames[b];
+  if (frame->tick != tick) {
+    clearNetFrame(frame, tick);
+    bot->fragments[b] = 0;
+    bot->total[b] = 0;
+    bot->broken[b] = false;
+  }
+  NetFrame* base = NULL;
+  if (baseTick != 0) {
+    base = &bot->frames[baseTick / NET_STATE_TICKS % NET_BASELINES];
+    if (base->tick != baseTick) {
+      base = NULL;
+      bot->broken[b] = true;
+    }
+  }
+
+  BitStream stream = { data, size, packet.at * 8, true };
+  while (!bot->broken[b] && readBits(&stream, 1)) {
+    if (decodeNetSnake(&stream, frame, base) < 0) bot->broken[b] = true;
+  }
+  if (!stream.ok) bot->broken[b] = true;
+  bot->fragments[b]++;
+  if (last) bot->total[b] = fragment + 1;
+  if (bot->total[b] == 0 || bot->fragments[b] < bot->total[b]) return;
+
+  if (bot->broken[b]) {
+    bot->failures++;
+    return;
+  }
+  bot->states++;
+  for (int s = 0; s < frame->slotCapacity; s++) bot->snakes += frame->snakes[s].first >= 0;
+  if (findNetSnake(frame, bot->slot) != NULL) bot->ownSeen++;
+  if ((int32_t)(tick - bot->stateAck) > 0) bot->stateAck = tick;
+}
+
+// Load generator: count clients on their own sockets, each sending
+// synthetic input every tick to the server at address for ticks ticks and
+// decoding the state it sends back
+int runBotClients(const char* address, int count, int ticks, float dt) {
+  struct sockaddr_in server;
+  if (!parseAddress(address, &server)) {
+    fprintf(stderr, "address must look like 127.0.0.1:7777\n");
+    return 1;
+  }
+  BotClient* bots = calloc(count, sizeof(BotClient));
+  for (int b = 0; b < count; b++) {
+    bots[b].fd = openUdpSocket(0);
+    if (bots[b].fd < 0) {
+      fprintf(stderr, "could not open socket %d\n", b);
+      count = b;
+      break;
+    }
+  }
+
+  unsigned char buffer[NET_MAX_PACKET];
+  double start = nowSeconds();
+  double next = start;
+  for (int tick = 0; tick < ticks; tick++) {
+    sleepUntil(next);
+    next += dt;
+
+    for (int b = 0; b < count; b++) {
+      BotClient* bot = &bots[b];
+      Packet packet = { buffer, sizeof(buffer), 0, true };
+      if (!bot->welcomed) {
+        packU8(&packet, NET_HELLO);
+      }
+      else {
+        // Each bot is its own player, a few seconds out of phase
+        InputFrame input;
+        syntheticInput(&input, tick + b * 97, dt);
+        bot->sequence++;
+        bot->sent[bot->sequence % 64] = nowSeconds();
+        packInput(&packet, bot->sequence, bot->stateAck, &input);
+      }
+      sendto(bot->fd, packet.data, packet.at, 0, (struct sockaddr*)&server, sizeof(server));
+
+      for (;;) {
+        int size = recv(bot->fd, buffer, sizeof(buffer), 0);
+        if (size <= 0) break;
+        Packet in = { buffer, size, 0, true };
+        int type = unpackU8(&in);
+        if (type == NET_WELCOME) {
+          bot->welcomed = true;
+          bot->slot = unpackU16(&in);
+        }
+        else if (type == NET_STATE) {
+          unpackU32(&in);
+          uint32_t acked = unpackU32(&in);
+          bot->packets++;
+          bot->bytes += size;
+          if (acked != 0 && bot->sequence - acked < 64) {
+            bot->rtt += nowSeconds() - bot->sent[acked % 64];
+            bot->rtts++;
+          }
+          receiveState(bot, buffer, size);
+        }
+      }
+    }
+  }
+  double elapsed = nowSeconds() - start;
+
+  long packets = 0, states = 0, snakes = 0, bytes = 0, ownSeen = 0, failures = 0, rtts = 0, welcomed = 0;
+  double rtt = 0;
+  for (int b = 0; b < count; b++) {
+    Packet packet = { buffer, sizeof(buffer), 0, true };
+    packU8(&packet, NET_BYE);
+    sendto(bots[b].fd, packet.data, packet.at, 0, (struct sockaddr*)&server, sizeof(server));
+    close(bots[b].fd);
+    for (int f = 0; f < NET_BASELINES; f++) freeNetFrame(&bots[b].frames[f]);
+    welcomed += bots[b].welcomed;
+    packets += bots[b].packets;
+    states += bots[b].states;
+    snakes += bots[b].snakes;
+    bytes += bots[b].bytes;
+    ownSeen += bots[b].ownSeen;
+    failures += bots[b].failures;
+    rtt += bots[b].rtt;
+    rtts += bots[b].rtts;
+  }
+  free(bots);
+
+  int clients = count ? count : 1;
+  printf("clients     %d (%ld welcomed)\n", count, welcomed);
+  printf("elapsed     %.3f s\n", elapsed);
+  printf("states      %.1f/s per client in %.1f packets/s, %ld undecodable\n",
+         states / elapsed / clients, packets / elapsed / clients, failures);
+  printf("received    %.1f KB/s per client\n", bytes / elapsed / 1024 / clients);
+  printf("per snake   %.1f bytes per tick\n", snakes ? (double)bytes / snakes / NET_STATE_TICKS : 0);
+  printf("own snake   in %.1f%% of states\n", states ? 100.0 * ownSeen / states : 0);
+  printf("round trip  %.2f ms average\n", rtts ? rtt / rtts * 1e3 : 0);
+  return 0;
+}
+
+// Parts of live snakes with a NaN or infinite coordinate, which a stable
+// simulation never produces
+long countBrokenParts(World* world) {
+  long broken = 0;
+  for (int s = 0; s < world->slotCount; s++) {
+    if (!world->alive[s]) continue;
+    const SnakeBody* body = &world->snakes[s].body;
+    for (int i = 0; i < body->count; i++) {
+      int j = snakePartIndex(body, i);
+      broken += !isfinite(body->x[j]) || !isfinite(body->y[j]);
+    }
+  }
+  return broken;
+}
+
+// Runs the simulation at a fixed dt from synthetic input, or from a
+// replay being played back, without opening a window or touching GL, for
+// soak tests and throughput numbers on machines with no GPU. Returns false
+// when a replay did not reproduce or any body part stopped being finite.
+bool runHeadless(World* world, int ticks, float dt, Replay* replay, SessionWriter* session) {
+  Camera2D camera = { .zoom = 1.0 };
+  bool playing = replay != NULL && !replay->writing;
+
+  InputFrame input;
+  double t0 = nowSeconds();
+  int tick = 0;
+  for (; tick < ticks; tick++) {
+    double frameStart = nowSeconds();
+    if (playing) {
+      if (!playTick(replay, &input, world)) break;
+    }
+    else {
+      PROFILE_SCOPE(PHASE_INPUT) syntheticInput(&input, tick, dt);
+    }
+    if (replay != NULL && replay->writing) recordTick(replay, &input, world);
+    if (session != NULL) recordSessionTick(session, &input, world, camera);
+    TRACE_SCOPE("tick") tickGame(&camera, world, &input, dt);
+    profiler.current[PHASE_FRAME] += nowSeconds() - frameStart;
+    profileEndFrame();
+  }
+  double elapsed = nowSeconds() - t0;
+  ticks = tick;
+
+  bool reproduced = true;
+  if (playing) reproduced = closeReplay(replay, world);
+  else if (replay != NULL) stopRecording(replay, world);
+  if (session != NULL) stopSession(session, world);
+
+  Snake* player = worldPlayer(world);
+  Vector2 head = snakeHead(player).pos;
+  Vector2 tail = snakeTail(player).pos;
+  long broken = countBrokenParts(world);
+  printf("ticks       %d (dt %g)\n", ticks, dt);
+  printf("snakes      %d\n", world->aliveCount);
+  printf("parts       %ld\n", snakeBodyStats.live);
+  printf("deaths      %ld\n", world->deaths);
+  printf("eaten       %ld of %d pellets\n", world->pellets.eaten, world->pellets.target);
+  printf("head        %.3f %.3f\n", head.x, head.y);
+  printf("tail        %.3f %.3f\n", tail.x, tail.y);
+  printf("non-finite  %ld parts\n", broken);
+  printf("checksum    %016lx\n", replayChecksum(world));
+  if (playing) printf("replay      %s\n", reproduced ? "reproduced" : "diverged");
+  printf("elapsed     %.3f s\n", elapsed);
+  printf("throughput  %.0f ticks/s, %.1f ns/tick\n", ticks / elapsed, elapsed * 1e9 / ticks);
+  printf("\nlast %d ticks\n", ticks < PROFILE_FRAMES ? ticks : PROFILE_FRAMES);
+  printProfile(stdout);
+
+  if (broken > 0) TraceLog(LOG_ERROR, "HEADLESS: %ld body parts are not finite", broken);
+  return reproduced && broken == 0;
+}
+
+int main(int argc, char** argv){
+  bool headless = false;
+  bool renderBenchmark = false;
+  BodyRenderMode bodyRenderMode = BODY_RENDER_INSTANCED;
+  BackgroundMode backgroundMode = BACKGROUND_DOTS;
+  SpeedlinesMode speedlinesMode = SPEEDLINES_BAKED;
+  int ticks = 60 * 60;
+  bool ticksGiven = false;  // A server runs until killed unless told
+  int bots = 0;
+  int pellets = 0;
+  bool profileOverlay = false;
+  const char* profileCsv = NULL;
+  const char* tracePath = NULL;
+  const char* recordPath = NULL;
+  const char* replayPath = NULL;
+  const char* sessionPath = NULL;
+  const char* playSessionPath = NULL;
+  int keyframeInterval = SESSION_KEYFRAME_TICKS;
+  const char* loadPath = NULL;
+  const char* savePath = NULL;
+  int seek = 0;
+  int serverPort = 0;
+  const char* connectAddress = NULL;
+  int botClients = 1;
+  int threads = countCores();
+  int windowWidth = WINDOW_WIDTH;
+  int windowHeight = WINDOW_HEIGHT;
+  float tickDt = 1.0 / TICK_RATE;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--bench-move") == 0) {
+      benchMove();
+      return 0;
+    }
+    else if (strcmp(argv[i], "--bench-jobs") == 0) {
+      benchJobs();
+      return 0;
+    }
+    else if (strcmp(argv[i], "--bench-render") == 0) {
+      renderBenchmark = true;
+    }
+    else if (strcmp(argv[i], "--bench-sim") == 0) {
+      benchSim();
+      return 0;
+    }
+    else if (strcmp(argv[i], "--bench-net") == 0) {
+      benchNet();
+      return 0;
+    }
+    else if (strcmp(argv[i], "--bench-death") == 0) {
+      benchDeath();
+      return 0;
+    }
+    else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--headless") == 0) {
+      headless = true;
+    }
+    else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) {
+      ticks = atoi(argv[++i]);
+      ticksGiven = true;
+    }
+    else if (strcmp(argv[i], "--snakes") == 0 && i + 1 < argc) {
+      bots = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--pellets") == 0 && i + 1 < argc) {
+      pellets = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--dt") == 0 && i + 1 < argc) {
+      tickDt = atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) {
+      tickDt = 1.0 / atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--profile") == 0) {
+      profileOverlay = true;
+    }
+    else if (strcmp(argv[i], "--profile-csv") == 0 && i + 1 < argc) {
+      profileCsv = argv[++i];
+    }
+    else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      recordPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      replayPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--record-session") == 0 && i + 1 < argc) {
+      sessionPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--keyframe-interval") == 0 && i + 1 < argc) {
+      keyframeInterval = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--play-session") == 0 && i + 1 < argc) {
+      playSessionPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--seek") == 0 && i + 1 < argc) {
+      seek = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--load-snake") == 0 && i + 1 < argc) {
+      loadPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--save-snake") == 0 && i + 1 < argc) {
+      savePath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+      serverPort = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+      connectAddress = argv[++i];
+    }
+    else if (strcmp(argv[i], "--bot-clients") == 0 && i + 1 < argc) {
+      botClients = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      tracePath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--window-size") == 0 && i + 1 < argc) {
+      if (sscanf(argv[++i], "%dx%d", &windowWidth, &windowHeight) != 2) {
+        fprintf(stderr, "window size must look like 1920x1080\n");
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "--background") == 0 && i + 1 < argc) {
+      const char* mode = argv[++i];
+      if (strcmp(mode, "dots") == 0) backgroundMode = BACKGROUND_DOTS;
+      else if (strcmp(mode, "texture") == 0) backgroundMode = BACKGROUND_TEXTURE;
+      else if (strcmp(mode, "shader") == 0) backgroundMode = BACKGROUND_SHADER;
+      else if (strcmp(mode, "shader-inverse") == 0) backgroundMode = BACKGROUND_SHADER_INVERSE;
+      else {
+        fprintf(stderr, "unknown background mode: %s\n", mode);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "--speedlines") == 0 && i + 1 < argc) {
+      const char* mode = argv[++i];
+      if (strcmp(mode, "baked") == 0) speedlinesMode = SPEEDLINES_BAKED;
+      else if (strcmp(mode, "procedural") == 0) speedlinesMode = SPEEDLINES_PROCEDURAL;
+      else {
+        fprintf(stderr, "unknown speedlines mode: %s\n", mode);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "--body-render") == 0 && i + 1 < argc) {
+      const char* mode = argv[++i];
+      if (strcmp(mode, "instanced") == 0) bodyRenderMode = BODY_RENDER_INSTANCED;
+      else if (strcmp(mode, "circles") == 0) bodyRenderMode = BODY_RENDER_CIRCLES;
+      else if (strcmp(mode, "tube") == 0) bodyRenderMode = BODY_RENDER_TUBE;
+      else {
+        fprintf(stderr, "unknown body render mode: %s\n", mode);
+        return 1;
+      }
+    }
+    else {
+      fprintf(stderr, "unknown argument: %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  // 1 / 0 and atof of garbage both land here
+  if (!isfinite(tickDt) || tickDt <= 0) {
+    fprintf(stderr, "tick length must be a positive number of seconds\n");
+    return 1;
+  }
+
+  if (renderBenchmark) {
+    benchRender(windowWidth, windowHeight);
+    return 0;
+  }
+
+  if (connectAddress != NULL) {
+    return runBotClients(connectAddress, botClients, ticks, tickDt);
+  }
+
+  // A replay brings its own settings
+  Replay replay;
+  Replay* activeReplay = NULL;
+  if (replayPath != NULL && recordPath != NULL) {
+    fprintf(stderr, "--record and --replay cannot be combined\n");
+    return 1;
+  }
+  // Replays start from initGame's player, not a loaded one
+  if (loadPath != NULL && (replayPath != NULL || recordPath != NULL)) {
+    fprintf(stderr, "--load-snake cannot be combined with --record or --replay\n");
+    return 1;
+  }
+  if (replayPath != NULL) {
+    if (!openReplay(&replay, replayPath)) return 1;
+    bots = replay.bots;
+    pellets = replay.pellets;
+    tickDt = replay.dt;
+    ticks = replay.ticks;
+    activeReplay = &replay;
+  }
+  if (recordPath != NULL) {
+    if (!startRecording(&replay, recordPath, bots, pellets, tickDt)) return 1;
+    activeReplay = &replay;
+  }
+
+  SessionWriter session;
+  SessionWriter* activeSession = NULL;
+  if (sessionPath != NULL) {
+    if (!startSession(&session, sessionPath, tickDt, keyframeInterval)) return 1;
+    activeSession = &session;
+  }
+
+  if (tracePath != NULL && !startTrace(tracePath)) return 1;
+
+  JobSystem jobs;
+  initJobSystem(&jobs, threads);
+
+  if (serverPort != 0) {
+    int status = runServer(serverPort, ticksGiven ? ticks : 0, tickDt, bots, pellets, &jobs);
+    if (profileCsv != NULL) writeProfileCsv(profileCsv);
+    stopTrace();
+    freeJobSystem(&jobs);
+    return status;
+  }
+
+  if (playSessionPath != NULL) {
+    bool reproduced = runSession(playSessionPath, seek, &jobs);
+    stopTrace();
+    freeJobSystem(&jobs);
+    return reproduced ? 0 : 1;
+  }
+
+  World world;
+  initGame(&world, bots, pellets);
+  world.jobs = &jobs;
+  if (loadPath != NULL && !loadSnake(&world.snakes[world.player], loadPath)) return 1;
+
+  if (headless) {
+    bool reproduced = runHeadless(&world, ticks, tickDt, activeReplay, activeSession);
+    if (savePath != NULL) saveSnake(worldPlayer(&world), savePath);
+    logSnakeBodyStats();
+    logPelletStats(&world.pellets);
+    freeWorld(&world);
+    if (profileCsv != NULL) writeProfileCsv(profileCsv);
+    stopTrace();
+    freeJobSystem(&jobs);
+    return reproduced ? 0 : 1;
+  }
+
+  InitWindow(windowWidth, windowHeight, "Snake");
+
+  Background background;
+  loadBackground(&background, backgroundMode);
+
+  Speedlines speedlines;
+  loadSpeedlines(&speedlines, speedlinesMode);
+
+  BodyRenderer bodyRenderer;
+  loadBodyRenderer(&bodyRenderer, bodyRenderMode);
+
+  float time = 0.0f;
+
+
+  Camera2D camera = {
+    .zoom = 1.0,
+    .offset = {0, 0},
+    .rotation = 0,
+    .target = {0, 0},
+  };
+
+  Camera2D previousCamera = camera;
+
+  float accumulator = 0;
+  unsigned int pressed = 0;
+  bool replayDone = false;
+
+  while(!WindowShouldClose()){
+    if (screen_mainmenu()) break;
+  }
+  while(!WindowShouldClose() && !replayDone){
+    double frameStart = nowSeconds();
+    float dt = GetFrameTime();
+    time += dt;
+
+    InputFrame input;
+    PROFILE_SCOPE(PHASE_INPUT) sampleInput(&input);
+    pressed |= input.buttons_pressed;
+    if (IsKeyPressed(KEY_F3)) profileOverlay = !profileOverlay;
+
+    accumulator += dt;
+    int steps = 0;
+    while (accumulator >= tickDt) {
+      if (steps == MAX_CATCHUP_TICKS) {
+        accumulator = fmodf(accumulator, tickDt);
+        break;
+      }
+      // Presses land on the first tick after they happen, even when a fast
+      // frame runs no tick at all
+      input.buttons_pressed = pressed;
+      pressed = 0;
+      InputFrame tickInput = input;
+      if (activeReplay != NULL && !activeReplay->writing) {
+        if (!playTick(activeReplay, &tickInput, &world)) {
+          replayDone = true;
+          break;
+        }
+      }
+      else if (activeReplay != NULL) {
+        recordTick(activeReplay, &tickInput, &world);
+      }
+      if (activeSession != NULL) recordSessionTick(activeSession, &tickInput, &world, camera);
+
+      previousCamera = camera;
+      TRACE_SCOPE("tick") tickGame(&camera, &world, &tickInput, tickDt);
+      accumulator -= tickDt;
+      steps++;
+    }
+    float alpha = accumulator / tickDt;
+    Camera2D view = lerpCamera(previousCamera, camera, alpha);
+
+    double drawStart = nowSeconds();
+    BeginDrawing();
+
+    PROFILE_SCOPE(PHASE_BACKGROUND) renderBackground(&background, view);
+
+    BeginMode2D(view);
+
+    PROFILE_SCOPE(PHASE_WORLD) renderWorld(&bodyRenderer, &world, view, alpha);
+
+    EndMode2D();
+
+    Snake* player = worldPlayer(&world);
+    PROFILE_SCOPE(PHASE_SPEEDLINES) {
+      if (player != NULL) renderSpeedlines(&speedlines, player, time);
+    }
+
+    if (profileOverlay) drawProfileOverlay();
+
+    PROFILE_SCOPE(PHASE_PRESENT) EndDrawing();
+    traceEvent("draw", drawStart, nowSeconds());
+
+    profiler.current[PHASE_FRAME] += nowSeconds() - frameStart;
+    traceEvent("frame", frameStart, nowSeconds());
+    profileEndFrame();
+  }
+
+  if (profileCsv != NULL) writeProfileCsv(profileCsv);
+  stopTrace();
+  if (activeReplay != NULL && activeReplay->writing) stopRecording(activeReplay, &world);
+  else if (activeReplay != NULL) closeReplay(activeReplay, &world);
+  if (activeSession != NULL) stopSession(activeSession, &world);
+  if (savePath != NULL) saveSnake(worldPlayer(&world), savePath);
+
+  logSnakeBodyStats();
+  logPelletStats(&world.pellets);
+  unloadBackground(&background);
+  unloadSpeedlines(&speedlines);
+  unloadBodyRenderer(&bodyRenderer);
+  freeWorld(&world);
+  freeJobSystem(&jobs);
   return 0;
 }
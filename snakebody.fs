@@ -0,0 +1,16 @@
+#version 330
+
+in vec2 fragTexCoord;
+in vec4 fragColor;
+
+out vec4 finalColor;
+
+void main() {
+    // Unit circle inscribed in the quad, antialiased over one pixel
+    float dist = length(fragTexCoord * 2.0 - 1.0);
+    float edge = fwidth(dist);
+    float alpha = 1.0 - smoothstep(1.0 - edge, 1.0, dist);
+    if (alpha <= 0.0) discard;
+
+    finalColor = vec4(fragColor.rgb, fragColor.a * alpha);
+}
@@ -0,0 +1,19 @@
+#version 330
+
+layout (location = 0) in vec3 vertexPosition;
+layout (location = 1) in vec2 vertexTexCoord;
+in mat4 instanceTransform;
+
+out vec2 fragTexCoord;
+out vec4 fragColor;
+
+uniform mat4 mvp;
+uniform int paletteSize;
+uniform vec4 palette[16];
+
+void main() {
+    // The quad is flat, so the z column is free to carry the palette index
+    fragColor = palette[int(instanceTransform[2].x) % paletteSize];
+    fragTexCoord = vertexTexCoord;
+    gl_Position = mvp * instanceTransform * vec4(vertexPosition, 1.0);
+}
@@ -0,0 +1,42 @@
+#version 330
+
+in vec2 worldPos;
+
+out vec4 finalColor;
+
+// One texel per polyline point, in rows: xy is the world position, z the
+// index of the part it came from, counted from the head
+uniform sampler2D polyline;
+uniform int pointCount;
+uniform float thickness;
+uniform int paletteSize;
+uniform vec4 palette[16];
+
+void main() {
+    float best = 1e20;
+    float bestPart = 0.0;
+
+    int width = textureSize(polyline, 0).x;
+    vec3 a = texelFetch(polyline, ivec2(0, 0), 0).xyz;
+    for (int i = 1; i < pointCount; i++) {
+        vec3 b = texelFetch(polyline, ivec2(i % width, i / width), 0).xyz;
+
+        // Distance to the capsule between a and b
+        vec2 pa = worldPos - a.xy;
+        vec2 ba = b.xy - a.xy;
+        float h = clamp(dot(pa, ba) / max(dot(ba, ba), 1e-6), 0.0, 1.0);
+        float d = length(pa - ba * h);
+        if (d < best) {
+            best = d;
+            bestPart = mix(a.z, b.z, h);
+        }
+        a = b;
+    }
+
+    float edge = fwidth(best);
+    float alpha = 1.0 - smoothstep(thickness - edge, thickness, best);
+    if (alpha <= 0.0) discard;
+
+    vec4 color = palette[int(mod(floor(bestPart + 0.5), float(paletteSize)))];
+    finalColor = vec4(color.rgb, color.a * alpha);
+}
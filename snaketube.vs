@@ -0,0 +1,13 @@
+#version 330
+
+layout (location = 0) in vec3 vertexPosition;
+
+out vec2 worldPos;
+
+uniform mat4 mvp;
+
+void main() {
+    // Drawn inside BeginMode2D, so positions arrive in world space
+    worldPos = vertexPosition.xy;
+    gl_Position = mvp * vec4(vertexPosition, 1.0);
+}
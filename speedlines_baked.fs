@@ -0,0 +1,30 @@
+#version 330 core
+
+in vec2 fragCoord;
+out vec4 finalColor;
+
+uniform vec2 iResolution;
+uniform float iTime;
+
+#define PI 3.1415
+uniform float RADIUS;
+
+// speedlines.fs's noise baked on the CPU: angle around the screen center
+// on x, time on y, stored as (noise + 1) / 2 and repeating every
+// noisePeriod lattice cells of time
+uniform sampler2D noiseTexture;
+uniform float noisePeriod;
+
+void main() {
+    // Convert to Shadertoy-like coordinates
+    vec2 uv = (gl_FragCoord.xy / iResolution.xy - 0.5) * 2.0;
+
+    float angle = atan(uv.y, uv.x) / (2.0 * PI);
+    float noise = texture(noiseTexture, vec2(angle, iTime * 10.0 / noisePeriod)).r * 2.0 - 1.0;
+    noise = noise < 0.2 ? 0.0 : 1.0;
+    
+    vec4 col = vec4(noise * (length(uv) - RADIUS) / RADIUS);
+    if (length(uv) < RADIUS) col = vec4(0.0);
+    
+    finalColor = col;
+}